@@ -0,0 +1,90 @@
+/*
+ * FixCodec.h
+ *
+ * Compact encoding of a batch of fixes for the HTTP body. Each fix is written
+ * as the difference with the previous one (the first one with 0), every field
+ * is zig-zag mapped then stored as a varint of 7 bits per byte. The bytes are
+ * wrapped in base64url so the body needs no escaping : "p=<base64url>".
+ *
+ *	byte 0			FIX_CODEC_VERSION
+ *	each fix		varint(zigzag(dTime)) varint(zigzag(dLatitude)) varint(zigzag(dLongitude))
+ *
+ * Differences are computed modulo 2^32, so any jump (antimeridian included)
+ * is decoded back exactly. A fix 10 s after the previous one in town takes
+ * about 5 bytes instead of about 30 characters in decimal.
+ *
+ * The codec only uses the standard headers, the decoder is shared with the
+ * host side tool (tools/fixdecode.cpp).
+ *
+ * Author: Karim Bouanane
+ * Hardware : ATMEGA328P
+ */
+
+
+#ifndef FIXCODEC_H_
+#define FIXCODEC_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "FixQueue.h"
+
+#define FIX_CODEC_VERSION		1
+#define FIX_CODEC_FIELD			"p="
+#define FIX_CODEC_MAX_BYTES		15		// 3 varints of 5 bytes at most
+
+
+class FixEncoder
+{
+
+private:	// private variables
+
+	char *buff;
+	size_t size;
+	size_t length;
+	uint16_t bits;			// bits waiting to be written as a base64 character
+	uint8_t bitCount;
+	Fix previous;
+	uint8_t count;
+
+private:	// private methods
+
+	void writeBytes(const uint8_t* data, uint8_t n);
+
+public:		// public methods
+
+	FixEncoder();
+
+	bool begin(char* buff, size_t size);
+	bool add(const Fix& fix);
+	size_t end();
+	uint8_t getCount();
+};
+
+
+class FixDecoder
+{
+
+private:	// private variables
+
+	const char *text;
+	uint16_t bits;
+	uint8_t bitCount;
+	Fix previous;
+	bool error;
+
+private:	// private methods
+
+	bool readByte(uint8_t* data);
+	bool readVarint(uint32_t* value, bool* started);
+
+public:		// public methods
+
+	FixDecoder();
+
+	bool begin(const char* text);
+	bool next(Fix* fix);
+	bool isValid();
+};
+
+#endif /* FIXCODEC_H_ */
@@ -0,0 +1,89 @@
+/*
+ * FixLog.h
+ *
+ * Circular log of the fixes kept in the EEPROM while the server can't be
+ * reached, so they survive a reset and are uploaded later. Each slot holds
+ * one record with its sequence number and a CRC. No write pointer is stored,
+ * the newest record is found at startup by its sequence number, so every
+ * slot wears the same.
+ *
+ * The records are written by the EEPROM ready interrupt, one byte at a time,
+ * so pushing a fix never waits for the 3.4 ms of each byte write.
+ *
+ * The last slot holds a count of the starts instead, it tells the server
+ * that the sequence numbers of the UDP datagrams start again.
+ *
+ * Author: Karim Bouanane
+ * Hardware : ATMEGA328P
+ */
+
+
+#ifndef FIXLOG_H_
+#define FIXLOG_H_
+
+#include <avr/io.h>
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "FixQueue.h"
+
+#define LOG_RECORD_SIZE		16
+#define LOG_SLOTS			((E2END + 1) / LOG_RECORD_SIZE - 1)	// 63 records in 1 KB
+#define LOG_BOOT_ADDRESS	(LOG_SLOTS * LOG_RECORD_SIZE)		// count of the starts, after the records
+#define LOG_WRITE_QUEUE		4		// records waiting for the interrupt writer
+#define LOG_MARK_QUEUE		8		// records waiting to be marked as sent
+
+#define LOG_PENDING			0xFF	// state of a record not sent, erased value of the EEPROM
+#define LOG_SENT			0x00
+
+
+typedef struct
+{
+	uint16_t seq;
+	uint32_t time;			// s		UTC time since 1970-01-01
+	int32_t latitude;		// deg		Latitude (1e-7)
+	int32_t longitude;		// deg		Longitude (1e-7)
+	uint8_t crc;			// CRC-8 of the fields above
+	uint8_t state;			// LOG_PENDING or LOG_SENT, written again once uploaded
+
+} __attribute__((packed)) LogRecord;
+
+
+class FixLog
+{
+
+private:	// private variables
+
+	uint8_t head;							// next slot written
+	uint8_t tail;							// oldest record not sent
+	uint8_t count;							// records not sent
+	uint8_t pending[(LOG_SLOTS + 7) / 8];	// slots holding a record not sent
+	uint16_t nextSeq;
+	uint16_t bootCount;
+	uint16_t droppedCount;
+
+private:	// private methods
+
+	bool isPending(uint8_t slot);
+	void setPending(uint8_t slot, bool value);
+	uint8_t nextPending(uint8_t slot);
+
+public:		// public methods
+
+	FixLog();
+
+	void begin();
+
+	// log
+	bool push(const Fix& fix);
+	uint8_t read(Fix* fixes, uint8_t max, uint8_t first = 0);
+	void markSent(uint8_t n);
+	uint8_t getCount();
+	bool isWriting();
+	uint16_t getBootCount();
+
+	// statistics
+	uint16_t getDroppedCount();
+};
+
+#endif /* FIXLOG_H_ */
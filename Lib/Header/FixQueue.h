@@ -0,0 +1,67 @@
+/*
+ * FixQueue.h
+ *
+ * RAM queue of the fixes waiting to be uploaded, so several fixes can be
+ * sent in one HTTP request. A batch is ready when it holds batchSize fixes
+ * or when its oldest fix has waited maxAge ms, whichever comes first.
+ *
+ * Author: Karim Bouanane
+ * Hardware : ATMEGA328P
+ */
+
+
+#ifndef FIXQUEUE_H_
+#define FIXQUEUE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define FIX_QUEUE_SIZE		8		// fixes kept in RAM, the oldest is dropped when full
+
+
+typedef struct
+{
+	uint32_t time;			// s		UTC time since 1970-01-01
+	long latitude;			// deg		Latitude (1e-7)
+	long longitude;			// deg		Longitude (1e-7)
+
+} Fix;
+
+
+class FixQueue
+{
+
+private:	// private variables
+
+	Fix fixes[FIX_QUEUE_SIZE];
+	uint32_t queuedAt[FIX_QUEUE_SIZE];	// timerNow() when each fix was pushed
+	uint8_t head;
+	uint8_t count;
+	uint8_t batchSize;
+	uint32_t maxAge;
+	uint16_t droppedCount;
+
+public:		// public methods
+
+	FixQueue(uint8_t size = 4, uint32_t age = 60000);
+
+	// settings
+	void setBatchSize(uint8_t size);
+	void setMaxAge(uint32_t age);
+
+	// queue
+	void push(const Fix& fix, uint32_t now);
+	const Fix* peek(uint8_t index);
+	void pop(uint8_t n);
+	uint8_t getCount();
+	bool isReady(uint32_t now, uint8_t first = 0);
+
+	// upload
+	size_t format(char* buff, size_t len, uint8_t* included, uint8_t first = 0);
+
+	// statistics
+	uint16_t getDroppedCount();
+};
+
+#endif /* FIXQUEUE_H_ */
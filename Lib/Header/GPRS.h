@@ -1,136 +1,364 @@
-/*
- * GPRS.h
- *
- * 
- * Author: Karim Bouanane
- */ 
-
-
-#ifndef GPRS_H_
-#define GPRS_H_
-
-#ifndef F_CPU
-	#define F_CPU 16000000UL
-#endif
-
-#include <avr/io.h>
-#include <stddef.h>
-#include <stdbool.h>
-#include <string.h>
-#include <stdlib.h>
-#include <util/delay.h>
-#include "swuart.h"
-
-#define MAX_DELAY	0xFFFFFFFF
-#define MAX_RETRY	0xFF
-
-
-typedef enum
-{
-	GPRS_TIMEOUT_REACHED	= 0,
-	GPRS_SUCCESS_REPLY,
-	GPRS_ERROR_REPLY,
-	UNINDENTIFIED_ERROR,
-		
-	/**** MODULE ****/
-
-	// Module Connection
-	GPRS_DISCONNECTED,
-	RESTART_FAIL,
-	
-	// SIM Card
-	NO_SIM_CARD,
-	PIN_REQUIRED,
-	
-	/**** GPRS ****/
-	
-	// GPRS Network
-	GPRS_REGISTRATION_FAIL,
-	ATTACH_NETWORK_FAIL,
-	
-	// PDP Context
-	ACTIVATE_PDPCONTEXT_FAIL,
-	DEACTIVATE_PDPCONTEXT_FAIL,
-
-	// HTTP Request
-	HTTP_SENDING_ERROR,
-	HTTP_CLIENT_ERROR,
-	HTTP_SERVER_ERRORS,
-	HTTP_UNKNOWN_ERROR,
-	
-	/**** GSM ****/
-	
-	// GSM registration
-	GSM_REGISTERATION_FAIL,
-		
-	// SMS
-	SMS_SENDING_ERROR,
-	
-	// Balance
-	CHECK_BALANCE_ERROR,
-	
-}GPRSCode;
-
-
-typedef enum
-{
-	Mode_normal = 0,
-	Mode_gpio_power_down = 1,
-	Mode_serial_power_down = 2
-	
-}SleepMode;
-
-
-class GPRS
-{
-
-	private: // private variables
-	
-		uint16_t errorCode;
-		
-	public : // public methods
-		
-		/**** A9 module ****/
-		void initSerial();
-		uint8_t waitReady();
-		uint8_t isConnected();
-		uint8_t restart();
-		uint8_t softReset();
-		uint8_t sleep(SleepMode type);
-		
-		// AT Command
-		uint8_t sendAT(const char* ATCommand, const char* exptReply, uint32_t timeout, uint8_t retry, bool catchError = false);
-		uint8_t waitResponse(const char* exptReply, uint32_t timeout, bool catchError = false);
-		uint16_t getErrorCode();
-		void setErrorCode(uint16_t code);
-				
-		// SIM Card
-		uint8_t isPINUnlocked();
-		uint8_t isSIMInserted();
-		
-		/**** GPRS ****/
-		uint8_t waitGPRSReg();
-		uint8_t attachMT();
-		uint8_t setupPDPContext();
-		uint8_t unsetupPDPContext();
-		uint8_t configureAPN(const char* apn);
-		uint8_t activateGPRS(const char* apn);
-		
-		// HTTP
-		uint8_t send_HTTP_POSTRequest(const char* httpURL, const char* contentType, const char* postData, uint8_t retry=1);
-		
-		/**** GSM ****/
-		uint8_t waitGSMReg();
-		uint8_t setSMSTextFormat();
-		uint8_t sendSMS(const char* phone_number, const char* message);
-		uint8_t readSMS(const char* phone_number ,const char* recv_message, size_t len);
-		
-		// Balance
-		uint8_t checkBalance(const char* code);
-		
-		// Location
-		uint8_t getLocation();
-
-};
-
+/*
+ * GPRS.h
+ *
+ * 
+ * Author: Karim Bouanane
+ */ 
+
+
+#ifndef GPRS_H_
+#define GPRS_H_
+
+#ifndef F_CPU
+	#define F_CPU 16000000UL
+#endif
+
+#include <avr/io.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <stdlib.h>
+#include <util/delay.h>
+#include "uart.h"
+#include "swuart.h"
+
+#define MAX_DELAY	0xFFFFFFFF
+#define MAX_RETRY	0xFF
+
+// serial port of the modem, SWUART or UART, bound at compile time
+#ifndef GPRS_SERIAL
+	#define GPRS_SERIAL		SWUART
+#endif
+
+#define AT_QUEUE_SIZE		10		// commands waiting in the asynchronous engine
+#define AT_MAX_ARGS			5		// arguments replacing the '%' of a command
+#define AT_REPLY_SIZE		24		// rest of the reply line kept after a match
+#define AT_COMMAND_DELAY	100		// ms between the sending of commands
+#define AT_CAPTURE_TIMEOUT	50		// ms to wait for the end of a captured reply line
+
+#define URC_LINE_SIZE			32			// longest line kept by the unsolicited result parser
+#define REGISTRATION_TIMEOUT	300000UL	// ms to wait for the network registration
+
+#define TCP_RESPONSE_QUEUE		4			// HTTP responses received on the socket and not read yet
+
+#define GPRS_PROFILE_BAUD		9600		// rate stored in the profile of the modem, used after each restart
+#define GPRS_BAUD				38400		// rate negotiated with AT+IPR, 57600 leaves less time to the other interrupts
+
+#define GPRS_WAKE_RETRY			200			// ms between two "AT" of the wake up handshake
+#define GPRS_WAKE_TIMEOUT		5000		// ms for the modem to answer once woken up
+#define GPRS_WAKE_PULSE			20			// ms the wake up pin is held low
+
+// optional pin wired to the wake up input of the A9, pulsed low before the
+// handshake. Without it only the serial power down mode can be woken up
+//#define GPRS_WAKE_PIN			PORTD4
+
+#ifdef GPRS_WAKE_PIN
+	#define GPRS_SLEEP_MODE		Mode_gpio_power_down
+#else
+	#define GPRS_SLEEP_MODE		Mode_serial_power_down
+#endif
+
+// ATCommand flags
+#define AT_CATCH_ERROR		0x01	// error replies end the retries
+#define AT_OPTIONAL			0x02	// failure doesn't abort the rest of the queue
+#define AT_CAPTURE_REPLY	0x04	// keep the rest of the reply line for the handler
+#define AT_RAW				0x08	// send the format as it is, without the command terminator
+
+
+typedef enum
+{
+	GPRS_TIMEOUT_REACHED	= 0,
+	GPRS_SUCCESS_REPLY,
+	GPRS_ERROR_REPLY,
+	UNINDENTIFIED_ERROR,
+		
+	/**** MODULE ****/
+
+	// Module Connection
+	GPRS_DISCONNECTED,
+	RESTART_FAIL,
+	
+	// SIM Card
+	NO_SIM_CARD,
+	PIN_REQUIRED,
+	
+	/**** GPRS ****/
+	
+	// GPRS Network
+	GPRS_REGISTRATION_FAIL,
+	ATTACH_NETWORK_FAIL,
+	
+	// PDP Context
+	ACTIVATE_PDPCONTEXT_FAIL,
+	DEACTIVATE_PDPCONTEXT_FAIL,
+
+	// HTTP Request
+	HTTP_SENDING_ERROR,
+	HTTP_CLIENT_ERROR,
+	HTTP_SERVER_ERRORS,
+	HTTP_UNKNOWN_ERROR,
+	
+	/**** GSM ****/
+	
+	// GSM registration
+	GSM_REGISTERATION_FAIL,
+		
+	// SMS
+	SMS_SENDING_ERROR,
+	
+	// Balance
+	CHECK_BALANCE_ERROR,
+	
+	/**** ASYNCHRONOUS ENGINE ****/
+	
+	GPRS_BUSY,
+	
+	/**** TCP ****/
+	
+	TCP_CONNECT_FAIL,
+	TCP_SEND_FAIL,
+	
+	/**** UDP ****/
+	
+	UDP_OPEN_FAIL,
+	UDP_SEND_FAIL,
+	
+	// Power
+	MODEM_WAKE_FAIL,
+	
+}GPRSCode;
+
+
+typedef enum
+{
+	Mode_normal = 0,
+	Mode_gpio_power_down = 1,
+	Mode_serial_power_down = 2
+	
+}SleepMode;
+
+
+// stat field of +CREG and +CGREG
+typedef enum
+{
+	REG_NOT_SEARCHING = 0,
+	REG_HOME = 1,
+	REG_SEARCHING = 2,
+	REG_DENIED = 3,
+	REG_UNKNOWN = 4,
+	REG_ROAMING = 5
+	
+}RegStatus;
+
+
+typedef enum
+{
+	SIM_UNKNOWN = 0,
+	SIM_READY,
+	SIM_PIN,
+	SIM_PUK,
+	SIM_NOT_INSERTED
+	
+}SIMStatus;
+
+
+// modem state kept up to date by the unsolicited result codes
+typedef struct
+{
+	uint8_t gsmReg;			// RegStatus
+	uint8_t gprsReg;		// RegStatus
+	uint8_t sim;			// SIMStatus
+	uint8_t smsIndex;		// storage index of the last received SMS
+	bool smsReceived;		// set by +CMTI, cleared by getNewSMS
+	bool socketOpen;		// set by CONNECT OK, cleared when the socket is closed
+	bool socketUDP;			// the socket is a UDP one
+	
+}ModemState;
+
+
+typedef enum
+{
+	EVENT_NONE = 0,
+	EVENT_GSM_REGISTERED,
+	EVENT_GPRS_REGISTERED,
+	EVENT_SIM_READY,
+	EVENT_SMS_RECEIVED
+	
+}ModemEvent;
+
+
+// map the reply of a command to a status, reply holds the captured line
+typedef uint8_t (*ATReplyHandler)(uint8_t status, const char* reply);
+
+typedef struct
+{
+	const char* format;				// command, each '%' is replaced by the next argument
+	const char* args[AT_MAX_ARGS];
+	const char* exptReply;
+	uint32_t timeout;
+	uint8_t retry;
+	uint8_t flags;
+	uint8_t failCode;				// status reported when the command fails, 0 to keep the reply status
+	ATReplyHandler handler;			// optional
+	uint8_t event;					// ModemEvent waited for when format is NULL
+	
+}ATCommand;
+
+
+typedef enum
+{
+	AT_IDLE = 0,
+	AT_WAIT_REPLY,
+	AT_CAPTURE,
+	AT_WAIT_EVENT,
+	AT_GUARD,
+	AT_WAKE					// wake up handshake before the next command
+	
+}ATState;
+
+
+class GPRS
+{
+
+	private: // private variables
+	
+		uint16_t errorCode;
+		
+		// asynchronous engine
+		ATCommand atQueue[AT_QUEUE_SIZE];
+		uint8_t atHead;
+		uint8_t atCount;
+		ATState atState;
+		uint8_t atRetry;
+		uint8_t atStatus;			// status of the reply being captured
+		uint8_t atResult;			// result of the queue, first failure wins
+		uint32_t atTimestamp;
+		SizedMatcher<MATCHER_MAX_PATTERNS> atMatcher;	// also used by the blocking waits, the queue is idle then
+		char atReply[AT_REPLY_SIZE];
+		uint8_t atReplyLength;
+		
+		// unsolicited result codes
+		ModemState modemState;
+		char urcLine[URC_LINE_SIZE];
+		uint8_t urcLength;
+		
+		// socket transport
+		RingBuffer<TCP_RESPONSE_QUEUE> tcpResponses;	// status of each HTTP response, in order
+		char socketSendLength[6];						// arguments of the data being queued
+		char tcpContentLength[6];
+		uint16_t udpAckSeq;								// last acknowledgment received
+		uint32_t udpAckBitmap;
+		bool udpAckReceived;
+		
+		// power state
+		uint8_t powerMode;			// SleepMode set by the last AT+SLEEP
+		uint8_t wakeStep;			// 0 waiting "OK" to "AT", 1 waiting "OK" to "AT+SLEEP=0"
+		uint32_t wakeStart;
+		uint32_t wakeLatency;		// ms from the wake up to the modem ready, last measure
+		uint32_t maxWakeLatency;
+		
+		// serial link
+		uint32_t baudRate;			// rate of serialGPRS, the modem is expected at the same one
+		
+	public : // public methods
+	
+		GPRS();
+		
+		/**** A9 module ****/
+		void initSerial();
+		uint8_t setBaud(uint32_t baud);
+		uint32_t getBaud();
+		uint8_t waitReady();
+		uint8_t isConnected();
+		uint8_t restart();
+		uint8_t softReset();
+		uint8_t sleep(SleepMode type);
+		uint8_t wakeup();
+		bool isAsleep();
+		uint32_t getWakeLatency();
+		uint32_t getMaxWakeLatency();
+		
+		// AT Command
+		uint8_t sendAT(const char* ATCommand, const char* exptReply, uint32_t timeout, uint8_t retry, bool catchError = false);
+		uint8_t waitResponse(const char* exptReply, uint32_t timeout, bool catchError = false);
+		uint16_t getErrorCode();
+		void setErrorCode(uint16_t code);
+		
+		// Asynchronous AT Command
+		bool queueAT(const ATCommand& command);
+		ATCommand* queueAT_P(const ATCommand* command);
+		uint8_t poll();
+		bool isBusy();
+		void abortQueue();
+		
+		// Unsolicited Result Code
+		const ModemState* getModemState();
+		bool isEventSet(ModemEvent event);
+		uint8_t waitEvent(ModemEvent event, uint32_t timeout);
+		bool getNewSMS(uint8_t* index);
+				
+		// SIM Card
+		uint8_t isPINUnlocked();
+		uint8_t isSIMInserted();
+		
+		/**** GPRS ****/
+		uint8_t waitGPRSReg();
+		uint8_t attachMT();
+		uint8_t setupPDPContext();
+		uint8_t unsetupPDPContext();
+		uint8_t configureAPN(const char* apn);
+		uint8_t activateGPRS(const char* apn);
+		bool beginActivateGPRS(const char* apn);
+		
+		// HTTP
+		uint8_t send_HTTP_POSTRequest(const char* httpURL, const char* contentType, const char* postData, uint8_t retry=1);
+		bool beginHTTPPOST(const char* httpURL, const char* contentType, const char* postData, uint8_t retry=1);
+		
+		// TCP
+		bool beginTCPConnect(const char* host, const char* port);
+		bool beginTCPPOST(const char* host, const char* path, const char* contentType, const char* postData);
+		bool isTCPConnected();
+		bool getTCPResponse(uint8_t* status);
+		
+		// UDP
+		bool beginUDPOpen(const char* host, const char* port);
+		bool beginUDPSend(const char* datagram);
+		bool isUDPOpen();
+		bool getUDPAck(uint16_t* seq, uint32_t* bitmap);
+		
+		// Socket
+		bool beginSocketClose();
+		
+		/**** GSM ****/
+		uint8_t waitGSMReg();
+		uint8_t setSMSTextFormat();
+		uint8_t sendSMS(const char* phone_number, const char* message);
+		bool beginSMS(const char* phone_number, const char* message);
+		uint8_t readSMS(const char* phone_number ,const char* recv_message, size_t len);
+		
+		// Balance
+		uint8_t checkBalance(const char* code);
+		
+		// Location
+		uint8_t getLocation();
+		
+	private: // private methods
+		
+		void startCommand();
+		void finishCommand(uint8_t status);
+		void queueSocketData(const ATCommand& data);
+		void startWakeup();
+		void pollWakeup();
+		void finishQueue();
+		uint8_t prepareCommand();
+		
+		bool readModem(char* data, uint32_t prev, uint32_t timeout);
+		size_t readModemLine(char* buff, size_t len, uint32_t timeout);
+		uint8_t waitAny(StreamMatcher& matcher, uint32_t timeout);
+		uint8_t waitOneOf(const char* target1, const char* target2, uint32_t timeout);
+		void processByte(char data);
+		void handleLine();
+
+};
+
 #endif /* GPRS_H_ */
\ No newline at end of file
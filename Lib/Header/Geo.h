@@ -0,0 +1,29 @@
+/*
+ * Geo.h
+ *
+ * Integer helpers for the small distances between two fixes. The earth is
+ * taken as flat around the first point (equirectangular projection), which
+ * is precise enough for the few km used by the reporting thresholds.
+ *
+ * Author: Karim Bouanane
+ * Hardware : ATMEGA328P
+ */
+
+
+#ifndef GEO_H_
+#define GEO_H_
+
+#include <stdint.h>
+
+#define GEO_UNITS_PER_METER		90			// 1e-7 deg of latitude in one meter (89.83)
+#define GEO_MAX_OFFSET			8000000L	// m, larger offsets are clamped
+#define GEO_COS_ONE				255			// scale of geoCos
+
+
+uint8_t geoCos(long latitude);
+void geoOffset(long fromLat, long fromLng, long toLat, long toLng, long* east, long* north);
+uint32_t geoDistance(long fromLat, long fromLng, long toLat, long toLng);
+uint16_t isqrt32(uint32_t value);
+
+
+#endif /* GEO_H_ */
@@ -0,0 +1,143 @@
+/*
+ * Geofence.h
+ *
+ * Zones checked on the tracker itself, so leaving the depot is known
+ * without a server round trip. A zone is a polygon or a circle kept in the
+ * flash, its bounding box is computed by the compiler so most fixes are
+ * sorted out by four comparisons :
+ *
+ *		constexpr GeoPoint depot[] PROGMEM = { { 335731000, -76120000 }, ... };
+ *		const char depotName[] PROGMEM = "depot";
+ *
+ *		constexpr GeoZone zones[] PROGMEM =
+ *		{
+ *			GEO_POLYGON(depot, depotName),
+ *			geoCircle(335890000, -75990000, 300, homeName)
+ *		};
+ *
+ * A transition is only reported once it is seen on two fixes in a row.
+ *
+ * Author: Karim Bouanane
+ * Hardware : ATMEGA328P
+ */
+
+
+#ifndef GEOFENCE_H_
+#define GEOFENCE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#define GEOFENCE_MAX_ZONES		8		// one bit of the zone masks each
+
+#define GEO_POLYGON(vertices, name)		geoPolygon(vertices, sizeof(vertices) / sizeof(GeoPoint), name)
+
+
+typedef struct
+{
+	long latitude;			// deg		Latitude (1e-7)
+	long longitude;			// deg		Longitude (1e-7)
+
+} GeoPoint;
+
+
+typedef struct
+{
+	long minLat;
+	long minLng;
+	long maxLat;
+	long maxLng;
+
+} GeoBox;
+
+
+typedef struct
+{
+	GeoBox box;
+	const GeoPoint* vertices;		// PROGMEM, NULL for a circle
+	uint8_t vertexCount;
+	GeoPoint center;				// circle only
+	uint16_t radius;				// m		circle only
+	const char* name;				// PROGMEM
+
+} GeoZone;
+
+
+/**** Compile time tables ****/
+
+constexpr long geoMin(long a, long b) { return a < b ? a : b; }
+constexpr long geoMax(long a, long b) { return a > b ? a : b; }
+
+constexpr GeoBox geoBoxAdd(GeoBox box, GeoPoint point)
+{
+	return GeoBox{ geoMin(box.minLat, point.latitude), geoMin(box.minLng, point.longitude),
+				   geoMax(box.maxLat, point.latitude), geoMax(box.maxLng, point.longitude) };
+}
+
+constexpr GeoBox geoBoxOf(const GeoPoint* vertices, uint8_t count)
+{
+	return count == 1 ? GeoBox{ vertices[0].latitude, vertices[0].longitude, vertices[0].latitude, vertices[0].longitude }
+					  : geoBoxAdd(geoBoxOf(vertices, count - 1), vertices[count - 1]);
+}
+
+// cos of a latitude (1e-7 deg), only evaluated by the compiler
+constexpr double geoCosSeries(double x2)
+{
+	return 1 - x2 / 2 * (1 - x2 / 12 * (1 - x2 / 30 * (1 - x2 / 56 * (1 - x2 / 90))));
+}
+
+constexpr double geoRadians(long latitude)
+{
+	return latitude * 1.745329252e-9;
+}
+
+// 1e-7 deg of longitude in a radius, with 1/8 of margin, up to 70 deg of latitude
+constexpr long geoCircleWidth(long latitude, uint16_t radius)
+{
+	return (long)(radius * 90.0 * 1.125 / geoCosSeries(geoRadians(latitude) * geoRadians(latitude)));
+}
+
+constexpr GeoZone geoCircle(long latitude, long longitude, uint16_t radius, const char* name)
+{
+	return GeoZone{ GeoBox{ latitude - radius * 90L, longitude - geoCircleWidth(latitude, radius),
+							latitude + radius * 90L, longitude + geoCircleWidth(latitude, radius) },
+					NULL, 0, GeoPoint{ latitude, longitude }, radius, name };
+}
+
+constexpr GeoZone geoPolygon(const GeoPoint* vertices, uint8_t count, const char* name)
+{
+	return GeoZone{ geoBoxOf(vertices, count), vertices, count, GeoPoint{ 0, 0 }, 0, name };
+}
+
+
+class Geofence
+{
+
+private:	// private variables
+
+	const GeoZone* zones;			// PROGMEM
+	uint8_t zoneCount;
+	uint8_t inside;					// zones the vehicle is in
+	uint8_t candidate;				// zones changed on the last fix, not confirmed yet
+	bool started;
+
+private:	// private methods
+
+	bool contains(const GeoZone* zone, long latitude, long longitude);
+	bool polygonContains(const GeoZone* zone, long latitude, long longitude);
+
+public:		// public methods
+
+	Geofence(const GeoZone* table, uint8_t count);
+
+	// zones
+	uint8_t update(long latitude, long longitude);
+	bool isInside(uint8_t zone);
+	uint8_t getInside();
+	uint8_t getZoneCount();
+	void getName(uint8_t zone, char* buff, size_t len);
+	void reset();
+};
+
+#endif /* GEOFENCE_H_ */
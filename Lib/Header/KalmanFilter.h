@@ -0,0 +1,92 @@
+/*
+ * KalmanFilter.h
+ *
+ * Constant velocity Kalman filter smoothing the GPS position, so the jitter
+ * of a parked vehicle and the jumps of multipath don't look like movement.
+ * Each axis (north, east) is filtered on its own in mm, in a local frame
+ * around an origin moved with the vehicle. The measurement noise comes from
+ * the accuracy estimates of the receiver (hAcc, sAcc), the velocity of
+ * NAV_PVT is used when it is available.
+ *
+ * Fixed point only : covariances in cm2, gains in Q16, 32 bit arithmetic
+ * without any 64 bit product or division. A position farther than KALMAN_GATE sigmas is ignored, several
+ * in a row restart the filter on the new position.
+ *
+ * Author: Karim Bouanane
+ * Hardware : ATMEGA328P
+ */
+
+
+#ifndef KALMANFILTER_H_
+#define KALMANFILTER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "NavSolution.h"
+
+#define KALMAN_ORIGIN_RANGE		100000L		// 1e-7 deg (about 1 km) from the origin before it is moved
+#define KALMAN_MAX_GAP			10000		// ms between two fixes, a longer gap restarts the filter
+#define KALMAN_GATE				3			// sigmas, farther positions are outliers
+#define KALMAN_MAX_OUTLIERS		5			// outliers in a row before the filter restarts
+#define KALMAN_MAX_ACCURACY		20000		// cm, larger accuracy estimates are clamped
+
+
+// state of one axis
+typedef struct
+{
+	long x;					// mm		position from the origin
+	long v;					// mm/s		velocity
+	long p00;				// cm2		position variance
+	long p01;				// cm2/s	covariance
+	long p11;				// cm2/s2	velocity variance
+
+} KalmanAxis;
+
+
+class KalmanFilter
+{
+
+private:	// private variables
+
+	KalmanAxis north;
+	KalmanAxis east;
+	long originLat;				// deg		origin of the local frame (1e-7)
+	long originLng;
+	uint8_t originCos;			// geoCos of the origin latitude
+	uint32_t lastTOW;			// ms		GPS time of the last fix
+	bool started;
+	uint8_t outliers;			// outliers in a row
+	uint16_t noise;				// cm2/s3	acceleration noise density
+	uint16_t outlierCount;
+
+private:	// private methods
+
+	void start(const NavSolution* nav);
+	void moveOrigin();
+	long toNorth(long latitude);
+	long toEast(long longitude);
+
+public:		// public methods
+
+	KalmanFilter(uint16_t q = 2500);
+
+	// settings
+	void setNoise(uint16_t q);
+
+	// filter
+	bool update(const NavSolution* nav);
+	void reset();
+
+	// estimate
+	long getLatitude();
+	long getLongitude();
+	long getVelocityNorth();
+	long getVelocityEast();
+	long getSpeed();
+	uint32_t getAccuracy();
+
+	// statistics
+	uint16_t getOutlierCount();
+};
+
+#endif /* KALMANFILTER_H_ */
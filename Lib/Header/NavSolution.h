@@ -0,0 +1,50 @@
+/*
+ * NavSolution.h
+ *
+ * Navigation data of one epoch, filled by UBXGPS from the decoded messages
+ * and used by the filter and the report policy. It stands alone so the host
+ * tools can build those without the serial drivers.
+ *
+ * Author: Karim Bouanane
+ * Hardware : ATMEGA328P
+ */
+
+
+#ifndef NAVSOLUTION_H_
+#define NAVSOLUTION_H_
+
+#include <stdint.h>
+
+
+// navigation data gathered from the decoded messages
+typedef struct
+{
+	uint32_t iTOW;			// ms		GPS time of week of the navigation epoch
+	long longitude;			// deg		Longitude (1e-7)
+	long latitude;			// deg		Latitude (1e-7)
+	long height;			// mm		Height above ellipsoid
+	long hMSL;				// mm		Height above mean sea level
+	uint32_t hAcc;			// mm		Horizontal accuracy estimate
+	uint32_t vAcc;			// mm		Vertical accuracy estimate
+	uint8_t gpsFix;			//			GPSfix type
+	uint8_t flags;			//			Navigation status flags, bit 0 gpsFixOk
+	
+	// NAV_PVT only
+	uint16_t year;			// y		UTC date and time
+	uint8_t month;			// month
+	uint8_t day;			// d
+	uint8_t hour;			// h
+	uint8_t min;			// min
+	uint8_t sec;			// s
+	uint8_t valid;			//			Validity flags of the UTC date and time
+	uint8_t numSV;			//			Number of satellites used in the solution
+	long velN;				// mm/s		NED north velocity
+	long velE;				// mm/s		NED east velocity
+	long gSpeed;			// mm/s		Ground speed
+	long headMot;			// deg		Heading of motion (1e-5)
+	uint32_t sAcc;			// mm/s		Speed accuracy estimate
+	uint32_t headAcc;		// deg		Heading accuracy estimate (1e-5)
+	
+} NavSolution;
+
+#endif /* NAVSOLUTION_H_ */
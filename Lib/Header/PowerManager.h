@@ -0,0 +1,72 @@
+/*
+ * PowerManager.h
+ *
+ * Sleep between the reports. The modem is put in its sleep mode, the GPS in
+ * backup mode and the MCU in power-down, woken up by the watchdog every 8 s
+ * at most. The periods are chained till the deadline, then timerNow() is
+ * moved forward by the time slept, since Timer1 is stopped meanwhile. The
+ * watchdog periods are calibrated against Timer1 from time to time, so the
+ * clock keeps within a few ms per minute of sleep.
+ *
+ * Timer2 can't keep the time in power-save here, its asynchronous mode needs
+ * a 32 kHz crystal on TOSC1/TOSC2, which are the pins of the 16 MHz crystal.
+ *
+ * In power-down only the watchdog, INT0/INT1 level and pin change interrupts
+ * can wake the MCU up. The GPS is woken up by a byte on its serial line and
+ * keeps its ephemeris, so the first fix is a hot start. The modem is left
+ * asleep, GPRS wakes it up before its next command only.
+ *
+ * Author: Karim Bouanane
+ * Hardware : ATMEGA328P
+ */
+
+
+#ifndef POWERMANAGER_H_
+#define POWERMANAGER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "GPRS.h"
+#include "Ublox.h"
+#include "WDTChain.h"
+
+#define POWER_MIN_SLEEP					16			// ms, shortest watchdog period
+#define POWER_CALIBRATION_TIME			1100		// ms, watchdog calibration in idle mode
+#define POWER_CALIBRATION_INTERVAL		3600000UL	// ms between two calibrations
+
+
+class PowerManager
+{
+
+private:	// private variables
+
+	GPRS* modem;				// NULL to leave the modem awake
+	Ublox* gnss;				// NULL to leave the GPS awake
+	WDTChain chain;				// calibrated periods and the us carried between them
+	uint32_t calibrationTime;	// timerNow() of the last calibration
+	bool calibrated;
+	uint32_t sleptTime;			// ms
+	uint16_t sleepCount;
+
+private:	// private methods
+
+	void calibrate();
+	void sleepPeriod(uint8_t index);
+
+public:		// public methods
+
+	PowerManager(GPRS* gprs = NULL, Ublox* gps = NULL);
+
+	void begin();
+
+	// sleep
+	uint32_t sleep(uint32_t ms);
+	uint32_t sleepUntil(uint32_t deadline);
+	uint16_t getWDTCalibration();
+
+	// statistics
+	uint32_t getSleptTime();
+	uint16_t getSleepCount();
+};
+
+#endif /* POWERMANAGER_H_ */
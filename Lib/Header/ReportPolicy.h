@@ -0,0 +1,64 @@
+/*
+ * ReportPolicy.h
+ *
+ * Decide which fixes are worth sending. While moving, a fix is reported when
+ * the vehicle went farther than a distance, turned more than an angle, or
+ * when the last report is too old. While stationary only a slow heartbeat is
+ * sent, unless the vehicle is moved.
+ *
+ * Author: Karim Bouanane
+ * Hardware : ATMEGA328P
+ */
+
+
+#ifndef REPORTPOLICY_H_
+#define REPORTPOLICY_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "UBXGPS.h"
+
+
+typedef struct
+{
+	uint16_t distance;		// m		distance from the last report
+	uint16_t heading;		// deg		turn since the last report, only while moving
+	uint16_t movingSpeed;	// mm/s		ground speed above which the vehicle moves
+	uint32_t minInterval;	// ms		time between two reports, at least
+	uint32_t maxInterval;	// ms		time between two reports while moving, at most
+	uint32_t heartbeat;		// ms		time between two reports while stationary
+
+} ReportThresholds;
+
+
+class ReportPolicy
+{
+
+private:	// private variables
+
+	ReportThresholds thresholds;
+	bool reported;				// a fix was reported since the start
+	long lastLatitude;			// last reported fix
+	long lastLongitude;
+	long lastHeading;
+	uint32_t lastTime;
+	uint16_t skippedCount;
+
+public:		// public methods
+
+	ReportPolicy();
+
+	// settings
+	void setThresholds(const ReportThresholds& value);
+	const ReportThresholds* getThresholds();
+
+	// decision
+	bool shouldReport(const NavSolution* nav, uint32_t now);
+	bool isMoving(const NavSolution* nav);
+	void reset();
+
+	// statistics
+	uint16_t getSkippedCount();
+};
+
+#endif /* REPORTPOLICY_H_ */
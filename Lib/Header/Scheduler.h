@@ -0,0 +1,61 @@
+/*
+ * Scheduler.h
+ *
+ * Cooperative scheduler built on timerNow(). Each task is a short function
+ * that must return quickly, it is called again once its period has elapsed.
+ * A task with a period of 0 is called at every tick.
+ *
+ * Author: Karim Bouanane
+ * Hardware : ATMEGA328P
+ */
+
+
+#ifndef SCHEDULER_H_
+#define SCHEDULER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "Timer.h"
+
+#define SCHEDULER_MAX_TASKS		6
+#define SCHEDULER_NO_TASK		0xFF
+
+
+typedef void (*TaskFunction)(void);
+
+typedef struct
+{
+	TaskFunction run;
+	uint32_t period;		// ms between two runs, 0 to run at every tick
+	uint32_t lastRun;		// time of the last scheduled run
+	bool enabled;
+
+} Task;
+
+
+class Scheduler
+{
+
+private:	// private variables
+
+	Task tasks[SCHEDULER_MAX_TASKS];
+	uint8_t count;
+
+public:		// public methods
+
+	Scheduler();
+
+	// Tasks
+	uint8_t addTask(TaskFunction run, uint32_t period, bool enabled = true);
+	void enable(uint8_t id);
+	void disable(uint8_t id);
+	void setPeriod(uint8_t id, uint32_t period);
+	void runNow(uint8_t id);
+
+	// Execution
+	void tick();
+	uint32_t timeToNextRun();
+};
+
+#endif /* SCHEDULER_H_ */
@@ -1,22 +1,25 @@
-/*
- * Timer.h
- *
- * This library uses the Timer1 peripheral with interrupts
- * to give the time in ms since the first initialization of timer
- *
- * Author: Karim Bouanane
- * Hardware : ATMEGA328P
- */ 
-
-
-#ifndef TIMER_H_
-#define TIMER_H_
-
-#include <avr/io.h>
-#include <util/atomic.h>
-#include <avr/interrupt.h>
-
-uint32_t timerNow();
-
-
+/*
+ * Timer.h
+ *
+ * This library uses the Timer1 peripheral free running, extended by its
+ * overflow interrupt, to give the time in ms and us since the first
+ * initialization of timer
+ *
+ * Author: Karim Bouanane
+ * Hardware : ATMEGA328P
+ */ 
+
+
+#ifndef TIMER_H_
+#define TIMER_H_
+
+#include <avr/io.h>
+#include <util/atomic.h>
+#include <avr/interrupt.h>
+
+uint32_t timerNow();
+uint32_t timerMicros();
+void timerAdvance(uint32_t ms);
+
+
 #endif /* TIMER_H_ */
\ No newline at end of file
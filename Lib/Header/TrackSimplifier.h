@@ -0,0 +1,79 @@
+/*
+ * TrackSimplifier.h
+ *
+ * Online simplification of the track before it is uploaded (sliding window
+ * Douglas-Peucker). The window starts at the last kept fix, the anchor, and
+ * grows while the segment from the anchor to the newest fix passes within
+ * the tolerance of every fix in between. When a new fix breaks it, the fix
+ * before it is kept and becomes the next anchor. The fixes in between are
+ * dropped, the track drawn from the kept ones stays within the tolerance.
+ *
+ * The fixes of the window are kept as m offsets from the anchor, so all the
+ * math fits in 32 bit integers.
+ *
+ * Author: Karim Bouanane
+ * Hardware : ATMEGA328P
+ */
+
+
+#ifndef TRACKSIMPLIFIER_H_
+#define TRACKSIMPLIFIER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "FixQueue.h"
+
+#define TRACK_WINDOW_SIZE	16			// fixes between the anchor and the newest fix, at most
+#define TRACK_MAX_SPAN		20000		// m from the anchor, farther fixes close the window
+
+
+typedef struct
+{
+	int16_t east;			// m		offset from the anchor
+	int16_t north;			// m
+
+} TrackPoint;
+
+
+class TrackSimplifier
+{
+
+private:	// private variables
+
+	TrackPoint points[TRACK_WINDOW_SIZE];	// fixes between the anchor and the newest one
+	uint8_t count;
+	Fix anchor;						// last kept fix
+	Fix last;						// newest fix, kept if the next one breaks the window
+	long lastEast;
+	long lastNorth;
+	bool started;					// the anchor is set
+	bool holding;					// last is set
+	uint32_t heldSince;				// timerNow() when the window started holding fixes
+	uint16_t tolerance;				// m
+	uint32_t maxHold;				// ms
+	uint16_t removedCount;
+
+private:	// private methods
+
+	bool isCovered(long east, long north);
+	void startWindow(const Fix& fix, uint32_t now);
+
+public:		// public methods
+
+	TrackSimplifier(uint16_t error = 10, uint32_t hold = 60000);
+
+	// settings
+	void setTolerance(uint16_t error);
+	void setMaxHold(uint32_t hold);
+
+	// simplification
+	bool push(const Fix& fix, uint32_t now, Fix* kept);
+	bool poll(uint32_t now, Fix* kept);
+	bool flush(Fix* kept);
+	void reset();
+
+	// statistics
+	uint16_t getRemovedCount();
+};
+
+#endif /* TRACKSIMPLIFIER_H_ */
@@ -0,0 +1,87 @@
+/*
+ * UDPWindow.h
+ *
+ * Fixes sent as UDP datagrams and not acknowledged yet. Each fix has its own
+ * datagram and sequence number, the server answers with the highest sequence
+ * number it received and a bitmap of the previous ones, so only the lost
+ * datagrams are sent again. When the window is full the oldest is dropped.
+ *
+ *	datagram		i=<device id>&k=<session>&s=<seq>&p=<fix encoded with FixCodec>
+ *	acknowledgment	a=<seq>&b=<bitmap>
+ *
+ * Bit k of the bitmap (hexadecimal) is set when seq - 1 - k was received.
+ * Sequence numbers are 16 bits and wrap around. They start again at 0 after
+ * a reset, with a new session number, so the server forgets the previous
+ * ones instead of taking the new datagrams for old duplicates.
+ *
+ * A datagram the acknowledgment can't tell about, older than the bitmap, is
+ * dropped rather than sent again on each acknowledgment.
+ *
+ * Author: Karim Bouanane
+ * Hardware : ATMEGA328P
+ */
+
+
+#ifndef UDPWINDOW_H_
+#define UDPWINDOW_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "FixQueue.h"
+
+#define UDP_WINDOW_SIZE		8		// datagrams kept till they are acknowledged
+#define UDP_ACK_BITS		32		// sequence numbers covered by the bitmap
+
+
+typedef struct
+{
+	Fix fix;
+	uint32_t sentAt;		// ms		timerNow() of the last sending
+	uint16_t seq;
+	uint8_t sendCount;		// 0 till it is sent the first time
+	bool missing;			// a later datagram was acknowledged without this one
+
+} Datagram;
+
+
+class UDPWindow
+{
+
+private:	// private variables
+
+	Datagram slots[UDP_WINDOW_SIZE];	// oldest first
+	uint8_t count;
+	uint16_t nextSeq;
+	uint16_t session;
+	uint32_t retryTimeout;
+	uint16_t droppedCount;
+	uint16_t retransmitCount;
+
+private:	// private methods
+
+	void remove(uint8_t index);
+
+public:		// public methods
+
+	UDPWindow(uint32_t timeout = 5000);
+
+	// settings
+	void setRetryTimeout(uint32_t timeout);
+	void setSession(uint16_t id);
+
+	// window
+	void push(const Fix& fix);
+	void acknowledge(uint16_t seq, uint32_t bitmap);
+	const Datagram* next(uint32_t now);
+	uint8_t getCount();
+
+	// datagram
+	size_t format(const Datagram* datagram, const char* id, char* buff, size_t len);
+
+	// statistics
+	uint16_t getDroppedCount();
+	uint16_t getRetransmitCount();
+};
+
+#endif /* UDPWINDOW_H_ */
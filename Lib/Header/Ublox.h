@@ -1,54 +1,91 @@
-/*
- * Ublox.h
- * Ublox-M8
- *
- * Author: Karim Bouanane
- * Hardware : Atmega328p
- */ 
-
-
-#ifndef UBLOX_H_
-#define UBLOX_H_
-
-#include "uart.h"
-
-
-typedef enum
-{
-	// module connection
-	GPS_SUCCESS_REPLY = 1,
-	GPS_DISCONNECTED,
-	GPS_RESTART_FFAIL,
-	
-}GPSCode;
-
-
-typedef enum
-{
-	NO_MESSAGE = 0x0000,
-	NAV_POSLLH = 0x0102,
-	NAV_STATUS = 0x0103
-	
-} MssgType;
-
-	
-class Ublox
-{
-	protected:
-	
-		UART serialGPS;
-	
-	public:
-		
-		uint8_t reset();
-		uint8_t isConnected();
-		uint8_t enableMessage(MssgType type);
-		uint8_t sendReceive(const char*cmd, size_t cmdLength, const char* resp, size_t respLength, uint32_t timeout);
-		
-		// control the power state of a GNSS module
-		uint8_t sleep(); 
-};
-
-
-
+/*
+ * Ublox.h
+ * Ublox-M8
+ *
+ * Author: Karim Bouanane
+ * Hardware : Atmega328p
+ */ 
+
+
+#ifndef UBLOX_H_
+#define UBLOX_H_
+
+#include "uart.h"
+#include "swuart.h"
+
+// serial port of the GPS, UART or SWUART, bound at compile time
+#ifndef GPS_SERIAL
+	#define GPS_SERIAL	UART
+#endif
+
+
+typedef enum
+{
+	// module connection
+	GPS_SUCCESS_REPLY = 1,
+	GPS_DISCONNECTED,
+	GPS_RESTART_FFAIL,
+	
+}GPSCode;
+
+
+typedef enum
+{
+	NO_MESSAGE = 0x0000,
+	NAV_POSLLH = 0x0102,
+	NAV_STATUS = 0x0103,
+	NAV_PVT = 0x0107
+	
+} MssgType;
+
+
+// called with the time to first fix in ms, once a fix follows a wakeup
+typedef void (*TTFFHandler)(uint32_t ttff);
+
+	
+class Ublox
+{
+	protected:
+	
+		GPS_SERIAL serialGPS;
+		
+		// power state
+		bool asleep;
+		bool waitingFix;			// woken up, no fix yet
+		uint32_t wakeupTime;		// timerNow() of the last wakeup
+		uint32_t timeToFix;			// ms, last measure
+		uint32_t averageTimeToFix;	// ms, moving average over 8 wakeups
+		TTFFHandler ttffHandler;
+		
+		void measureTimeToFix();
+		bool waitAck(uint16_t id, uint32_t timeout);
+	
+	public:
+		
+		Ublox();
+		
+		uint8_t reset();
+		uint8_t isConnected();
+		uint8_t enableMessage(MssgType type);
+		uint8_t disableMessage(MssgType type);
+		uint8_t setMessageRate(MssgType type, uint8_t rate);
+		uint8_t sendReceive(const char*cmd, size_t cmdLength, const char* resp, size_t respLength, uint32_t timeout);
+		void sendUBX(uint16_t id, const uint8_t* payload, uint16_t length);
+		
+		// control the power state of a GNSS module
+		uint8_t sleep(uint32_t duration = 0);
+		uint8_t wakeup();
+		uint8_t setPowerSave(uint32_t updatePeriod, uint32_t searchPeriod, uint16_t onTime);
+		uint8_t setContinuous();
+		bool isAsleep();
+		
+		// time to first fix after a wakeup
+		bool isWaitingFix();
+		uint32_t getTimeToFix();
+		uint32_t getAverageTimeToFix();
+		void setTTFFHandler(TTFFHandler handler);
+};
+
+
+
 #endif /* UBLOX_H_ */
\ No newline at end of file
@@ -0,0 +1,51 @@
+/*
+ * WDTChain.h
+ *
+ * Accounting of the watchdog periods chained by PowerManager. A period is
+ * 16 ms << index nominal, scaled by the calibration, which is the length in
+ * ms of a 1024 ms period measured against Timer1. Each period is credited
+ * in whole ms, the us below 1 ms are carried to the next one so nothing is
+ * lost over a long sleep.
+ *
+ * Only the standard headers are used, the chain is checked on the host by
+ * tools/sleepcheck.cpp.
+ *
+ * Author: Karim Bouanane
+ * Hardware : ATMEGA328P
+ */
+
+
+#ifndef WDTCHAIN_H_
+#define WDTCHAIN_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define WDT_PERIODS			10			// SLEEP_15MS to SLEEP_8S
+#define WDT_CHAIN_DONE		0xFF		// no period fits before the deadline
+#define WDT_NOMINAL			1024		// ms of the calibrated period
+
+
+class WDTChain
+{
+
+private:	// private variables
+
+	uint16_t calibration;		// ms measured for a 1024 ms watchdog period
+	uint16_t remainder;			// us slept below 1 ms, always under 1000
+
+public:		// public methods
+
+	WDTChain();
+
+	// calibration
+	void setCalibration(uint16_t ms);
+	uint16_t getCalibration();
+
+	// chain
+	uint32_t periodMicros(uint8_t index);
+	uint8_t next(int32_t left);
+	uint16_t credit(uint8_t index);
+};
+
+#endif /* WDTCHAIN_H_ */
@@ -0,0 +1,295 @@
+/*
+ * FixCodec.cpp
+ *
+ * Delta, zig-zag and varint encoding of the fixes, wrapped in base64url
+ *
+ * Author: Karim Bouanane
+ * Hardware : ATMEGA328P
+ */
+
+#include <string.h>
+#include "FixCodec.h"
+
+
+static const char base64url[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789-_";
+
+
+/**** Helpers ****/
+
+static inline uint32_t zigzag(uint32_t delta)
+{
+	return (delta << 1) ^ (uint32_t)((int32_t)delta >> 31);
+}
+
+
+static inline uint32_t unzigzag(uint32_t value)
+{
+	return (value >> 1) ^ (uint32_t)-(int32_t)(value & 1);
+}
+
+
+static uint8_t putVarint(uint8_t* data, uint32_t value)
+{
+	uint8_t n = 0;
+
+	while (value >= 0x80)
+	{
+		data[n++] = (uint8_t)value | 0x80;
+		value >>= 7;
+	}
+
+	data[n++] = (uint8_t)value;
+	return n;
+}
+
+
+static int8_t base64Value(char c)
+{
+	if (c >= 'A' && c <= 'Z')	return c - 'A';
+	if (c >= 'a' && c <= 'z')	return c - 'a' + 26;
+	if (c >= '0' && c <= '9')	return c - '0' + 52;
+	if (c == '-')				return 62;
+	if (c == '_')				return 63;
+
+	return -1;
+}
+
+
+/**** Encoder ****/
+
+FixEncoder::FixEncoder()
+	: buff(NULL)
+	, size(0)
+	, length(0)
+	, bits(0)
+	, bitCount(0)
+	, count(0)
+{
+	previous.time = 0;
+	previous.latitude = 0;
+	previous.longitude = 0;
+}
+
+
+// start a new body in buff, return false if it is too small for any fix
+bool FixEncoder::begin(char* buff, size_t size)
+{
+	const uint8_t version = FIX_CODEC_VERSION;
+
+	this->buff = buff;
+	this->size = size;
+	length = 0;
+	bits = 0;
+	bitCount = 0;
+	count = 0;
+	previous.time = 0;
+	previous.latitude = 0;
+	previous.longitude = 0;
+
+	// field name, version character(s) and '\0'
+	if (size < sizeof(FIX_CODEC_FIELD) + 2)
+	{
+		this->size = 0;
+		return false;
+	}
+
+	strcpy(buff, FIX_CODEC_FIELD);
+	length = strlen(buff);
+
+	writeBytes(&version, 1);
+	return true;
+}
+
+
+// append a fix, return false if it does not fit in the buffer
+bool FixEncoder::add(const Fix& fix)
+{
+	uint8_t data[FIX_CODEC_MAX_BYTES];
+	uint8_t n = 0;
+	uint16_t total;
+
+	if (size == 0)
+		return false;
+
+	n += putVarint(data + n, zigzag(fix.time - previous.time));
+	n += putVarint(data + n, zigzag((uint32_t)fix.latitude - (uint32_t)previous.latitude));
+	n += putVarint(data + n, zigzag((uint32_t)fix.longitude - (uint32_t)previous.longitude));
+
+	// characters once flushed, plus the '\0'
+	total = bitCount + 8 * n;
+
+	if (length + (total + 5) / 6 + 1 > size)
+		return false;
+
+	writeBytes(data, n);
+	previous = fix;
+	count++;
+
+	return true;
+}
+
+
+// flush the last bits and terminate the string, return its length
+size_t FixEncoder::end()
+{
+	if (size == 0)
+		return 0;
+
+	if (bitCount != 0)
+	{
+		buff[length++] = base64url[(bits << (6 - bitCount)) & 0x3F];
+		bitCount = 0;
+	}
+
+	buff[length] = '\0';
+	return length;
+}
+
+
+uint8_t FixEncoder::getCount()
+{
+	return count;
+}
+
+
+void FixEncoder::writeBytes(const uint8_t* data, uint8_t n)
+{
+	while (n--)
+	{
+		bits = (bits << 8) | *data++;
+		bitCount += 8;
+
+		while (bitCount >= 6)
+		{
+			bitCount -= 6;
+			buff[length++] = base64url[(bits >> bitCount) & 0x3F];
+		}
+	}
+}
+
+
+/**** Decoder ****/
+
+FixDecoder::FixDecoder()
+	: text(NULL)
+	, bits(0)
+	, bitCount(0)
+	, error(true)
+{
+	previous.time = 0;
+	previous.latitude = 0;
+	previous.longitude = 0;
+}
+
+
+// accept the body with or without its field name
+bool FixDecoder::begin(const char* text)
+{
+	uint8_t version;
+
+	if (strncmp(text, FIX_CODEC_FIELD, strlen(FIX_CODEC_FIELD)) == 0)
+		text += strlen(FIX_CODEC_FIELD);
+
+	this->text = text;
+	bits = 0;
+	bitCount = 0;
+	error = false;
+	previous.time = 0;
+	previous.latitude = 0;
+	previous.longitude = 0;
+
+	if (readByte(&version) == false || version != FIX_CODEC_VERSION)
+		error = true;
+
+	return error == false;
+}
+
+
+// return false at the end of the body, or when it is malformed
+bool FixDecoder::next(Fix* fix)
+{
+	uint32_t value[3];
+	bool started = false;
+
+	if (error)
+		return false;
+
+	for (uint8_t i = 0; i < 3; i++)
+	{
+		if (readVarint(&value[i], &started) == false)
+		{
+			// the body can only end between two fixes
+			if (started)
+				error = true;
+
+			return false;
+		}
+	}
+
+	previous.time += unzigzag(value[0]);
+	previous.latitude = (int32_t)((uint32_t)previous.latitude + unzigzag(value[1]));
+	previous.longitude = (int32_t)((uint32_t)previous.longitude + unzigzag(value[2]));
+
+	*fix = previous;
+	return true;
+}
+
+
+bool FixDecoder::isValid()
+{
+	return error == false;
+}
+
+
+bool FixDecoder::readByte(uint8_t* data)
+{
+	int8_t value;
+
+	while (bitCount < 8)
+	{
+		if (*text == '\0' || *text == '&')
+			return false;
+
+		value = base64Value(*text++);
+
+		if (value < 0)
+		{
+			error = true;
+			return false;
+		}
+
+		bits = (bits << 6) | value;
+		bitCount += 6;
+	}
+
+	bitCount -= 8;
+	*data = bits >> bitCount;
+	return true;
+}
+
+
+bool FixDecoder::readVarint(uint32_t* value, bool* started)
+{
+	uint8_t data;
+	uint8_t shift = 0;
+
+	*value = 0;
+
+	do
+	{
+		if (shift > 28 || readByte(&data) == false)
+		{
+			if (shift > 28)
+				error = true;
+
+			return false;
+		}
+
+		*started = true;
+		*value |= (uint32_t)(data & 0x7F) << shift;
+		shift += 7;
+
+	} while (data & 0x80);
+
+	return true;
+}
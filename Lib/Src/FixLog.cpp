@@ -0,0 +1,337 @@
+/*
+ * FixLog.cpp
+ *
+ * Circular log of the fixes kept in the EEPROM, written in the background by
+ * the EEPROM ready interrupt
+ *
+ * Author: Karim Bouanane
+ * Hardware : ATMEGA328P
+ */
+
+#include <avr/interrupt.h>
+#include <avr/eeprom.h>
+#include <util/atomic.h>
+#include <util/crc16.h>
+#include <string.h>
+#include "FixLog.h"
+
+#define LOG_CRC_INIT	0xFF	// an erased or a cleared slot never has a valid CRC
+
+static_assert(sizeof(LogRecord) == LOG_RECORD_SIZE, "a LogRecord must fill one slot");
+
+
+/**** Interrupt writer ****/
+
+static volatile uint8_t writeQueue[LOG_WRITE_QUEUE][LOG_RECORD_SIZE];
+static volatile uint8_t writeSlot[LOG_WRITE_QUEUE];
+static volatile uint8_t writeHead;
+static volatile uint8_t writeCount;
+static volatile uint8_t writeIndex;		// bytes of the record at writeHead already written
+
+static volatile uint8_t markSlot[LOG_MARK_QUEUE];
+static volatile uint8_t markHead;
+static volatile uint8_t markCount;
+
+
+static inline uint16_t slotAddress(uint8_t slot)
+{
+	return (uint16_t)slot * LOG_RECORD_SIZE;
+}
+
+
+// program one byte, unless the EEPROM already holds it
+static inline void writeByte(uint16_t address, uint8_t data)
+{
+	EEAR = address;
+	EECR |= _BV(EERE);
+
+	if (EEDR == data)
+		return;
+
+	EEDR = data;
+	EECR |= _BV(EEMPE);
+	EECR |= _BV(EEPE);
+}
+
+
+// called each time the previous write is done
+ISR(EE_READY_vect)
+{
+	uint8_t offset;
+
+	// a mark always concerns a record already written, it goes first
+	if (markCount != 0)
+	{
+		writeByte(slotAddress(markSlot[markHead]) + offsetof(LogRecord, state), LOG_SENT);
+		markHead = (markHead + 1) % LOG_MARK_QUEUE;
+		markCount--;
+	}
+	else if (writeCount != 0)
+	{
+		// the state byte goes first, a reset in the middle of the record can
+		// only bring back the previous record, never hide the new one as sent
+		offset = (writeIndex + LOG_RECORD_SIZE - 1) % LOG_RECORD_SIZE;
+
+		writeByte(slotAddress(writeSlot[writeHead]) + offset, writeQueue[writeHead][offset]);
+
+		if (++writeIndex == LOG_RECORD_SIZE)
+		{
+			writeIndex = 0;
+			writeHead = (writeHead + 1) % LOG_WRITE_QUEUE;
+			writeCount--;
+		}
+	}
+	else
+	{
+		EECR &= ~_BV(EERIE);		// nothing left, enabled again by the next write
+	}
+}
+
+
+/**** Records ****/
+
+static uint8_t recordCRC(const LogRecord* record)
+{
+	const uint8_t* data = (const uint8_t*)record;
+	uint8_t crc = LOG_CRC_INIT;
+
+	for (uint8_t i = 0; i < offsetof(LogRecord, crc); i++)
+		crc = _crc8_ccitt_update(crc, data[i]);
+
+	return crc;
+}
+
+
+// return false if the slot holds no valid record
+static bool readRecord(uint8_t slot, LogRecord* record)
+{
+	eeprom_read_block(record, (const void*)(uintptr_t)slotAddress(slot), LOG_RECORD_SIZE);
+
+	return record->crc == recordCRC(record);
+}
+
+
+FixLog::FixLog()
+	: head(0)
+	, tail(0)
+	, count(0)
+	, nextSeq(0)
+	, bootCount(0)
+	, droppedCount(0)
+{
+	memset(pending, 0, sizeof(pending));
+}
+
+
+// find the newest record and the records not sent, before any write
+void FixLog::begin()
+{
+	LogRecord record;
+	bool found = false;
+	uint16_t lastSeq = 0;
+	uint8_t last = 0;
+	uint8_t slot;
+
+	// written before the interrupt writer starts, the erased count starts at 0
+	bootCount = eeprom_read_word((const uint16_t*)LOG_BOOT_ADDRESS) + 1;
+	eeprom_update_word((uint16_t*)LOG_BOOT_ADDRESS, bootCount);
+
+	for (slot = 0; slot < LOG_SLOTS; slot++)
+	{
+		if (readRecord(slot, &record) == false)
+			continue;
+
+		if (found == false || (int16_t)(record.seq - lastSeq) > 0)
+		{
+			found = true;
+			lastSeq = record.seq;
+			last = slot;
+		}
+	}
+
+	if (found)
+	{
+		head = (last + 1) % LOG_SLOTS;
+		nextSeq = lastSeq + 1;
+	}
+
+	// oldest first, the slot after the newest record holds the oldest one
+	for (uint8_t i = 0; i < LOG_SLOTS; i++)
+	{
+		slot = (head + i) % LOG_SLOTS;
+
+		if (readRecord(slot, &record) == false || record.state != LOG_PENDING)
+			continue;
+
+		if (count == 0)
+			tail = slot;
+
+		setPending(slot, true);
+		count++;
+	}
+}
+
+
+/**** Log ****/
+
+// return false if the writer can't take the record now
+bool FixLog::push(const Fix& fix)
+{
+	LogRecord record;
+	const uint8_t* data = (const uint8_t*)&record;
+	uint8_t index;
+
+	if (writeCount >= LOG_WRITE_QUEUE)
+		return false;
+
+	// the log is full, the oldest record not sent is overwritten
+	if (isPending(head))
+	{
+		setPending(head, false);
+		count--;
+		droppedCount++;
+		tail = nextPending(head);
+	}
+
+	record.seq = nextSeq++;
+	record.time = fix.time;
+	record.latitude = fix.latitude;
+	record.longitude = fix.longitude;
+	record.crc = recordCRC(&record);
+	record.state = LOG_PENDING;
+
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		index = (writeHead + writeCount) % LOG_WRITE_QUEUE;
+
+		for (uint8_t i = 0; i < LOG_RECORD_SIZE; i++)
+			writeQueue[index][i] = data[i];
+
+		writeSlot[index] = head;
+		writeCount++;
+		EECR |= _BV(EERIE);
+	}
+
+	if (count == 0)
+		tail = head;
+
+	setPending(head, true);
+	count++;
+	head = (head + 1) % LOG_SLOTS;
+
+	return true;
+}
+
+
+// copy up to max records not sent, oldest first, after skipping the first
+// ones. Nothing is read while the writer is busy, it returns 0
+uint8_t FixLog::read(Fix* fixes, uint8_t max, uint8_t first)
+{
+	LogRecord record;
+	uint8_t slot = tail;
+	uint8_t n = 0;
+
+	if (isWriting())
+		return 0;
+
+	for (uint8_t i = 0; i < count && n < max; i++)
+	{
+		if (i >= first)
+		{
+			readRecord(slot, &record);
+
+			fixes[n].time = record.time;
+			fixes[n].latitude = record.latitude;
+			fixes[n].longitude = record.longitude;
+			n++;
+		}
+
+		slot = nextPending(slot);
+	}
+
+	return n;
+}
+
+
+// the n oldest records reached the server
+void FixLog::markSent(uint8_t n)
+{
+	while (n-- != 0 && count != 0)
+	{
+		// when the queue is full the record stays pending in the EEPROM,
+		// it is only sent again after a reset
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			if (markCount < LOG_MARK_QUEUE)
+			{
+				markSlot[(markHead + markCount) % LOG_MARK_QUEUE] = tail;
+				markCount++;
+				EECR |= _BV(EERIE);
+			}
+		}
+
+		setPending(tail, false);
+		count--;
+		tail = nextPending(tail);
+	}
+}
+
+
+uint8_t FixLog::getCount()
+{
+	return count;
+}
+
+
+bool FixLog::isWriting()
+{
+	return writeCount != 0 || markCount != 0 || (EECR & _BV(EERIE));
+}
+
+
+// starts counted by begin(), this one included
+uint16_t FixLog::getBootCount()
+{
+	return bootCount;
+}
+
+
+bool FixLog::isPending(uint8_t slot)
+{
+	return pending[slot / 8] & _BV(slot % 8);
+}
+
+
+void FixLog::setPending(uint8_t slot, bool value)
+{
+	if (value)
+		pending[slot / 8] |= _BV(slot % 8);
+	else
+		pending[slot / 8] &= ~_BV(slot % 8);
+}
+
+
+// next slot holding a record not sent, the slot itself if there is none
+uint8_t FixLog::nextPending(uint8_t slot)
+{
+	uint8_t next;
+
+	for (uint8_t i = 1; i < LOG_SLOTS; i++)
+	{
+		next = (slot + i) % LOG_SLOTS;
+
+		if (isPending(next))
+			return next;
+	}
+
+	return slot;
+}
+
+
+/**** Statistics ****/
+
+// records overwritten before they were sent
+uint16_t FixLog::getDroppedCount()
+{
+	return droppedCount;
+}
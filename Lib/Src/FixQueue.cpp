@@ -0,0 +1,129 @@
+/*
+ * FixQueue.cpp
+ *
+ * RAM queue of the fixes waiting to be uploaded, so several fixes can be
+ * sent in one HTTP request
+ *
+ * Author: Karim Bouanane
+ * Hardware : ATMEGA328P
+ */
+
+#include "FixQueue.h"
+#include "FixCodec.h"
+
+
+FixQueue::FixQueue(uint8_t size, uint32_t age)
+	: head(0)
+	, count(0)
+	, batchSize(size)
+	, maxAge(age)
+	, droppedCount(0)
+{
+}
+
+
+/**** Settings ****/
+
+void FixQueue::setBatchSize(uint8_t size)
+{
+	if (size == 0)
+		size = 1;
+
+	batchSize = size > FIX_QUEUE_SIZE ? FIX_QUEUE_SIZE : size;
+}
+
+
+void FixQueue::setMaxAge(uint32_t age)
+{
+	maxAge = age;
+}
+
+
+/**** Queue ****/
+
+void FixQueue::push(const Fix& fix, uint32_t now)
+{
+	if (count == FIX_QUEUE_SIZE)
+	{
+		pop(1);				// keep the most recent fixes
+		droppedCount++;
+	}
+
+	uint8_t i = (head + count) % FIX_QUEUE_SIZE;
+
+	fixes[i] = fix;
+	queuedAt[i] = now;
+	count++;
+}
+
+
+// index 0 is the oldest fix
+const Fix* FixQueue::peek(uint8_t index)
+{
+	if (index >= count)
+		return NULL;
+
+	return &fixes[(head + index) % FIX_QUEUE_SIZE];
+}
+
+
+void FixQueue::pop(uint8_t n)
+{
+	if (n > count)
+		n = count;
+
+	head = (head + n) % FIX_QUEUE_SIZE;
+	count -= n;
+}
+
+
+uint8_t FixQueue::getCount()
+{
+	return count;
+}
+
+
+// the fixes before first are already sent and waiting for their acknowledgment
+bool FixQueue::isReady(uint32_t now, uint8_t first)
+{
+	if (first >= count)
+		return false;
+
+	return count - first >= batchSize || now - queuedAt[(head + first) % FIX_QUEUE_SIZE] >= maxAge;
+}
+
+
+/**** Upload ****/
+
+// write the form body "p=..." (see FixCodec.h) with as many fixes as fit
+// in buff, starting from the fix at index first. included receives the
+// number of fixes written, they must be popped once the upload succeeded
+size_t FixQueue::format(char* buff, size_t len, uint8_t* included, uint8_t first)
+{
+	FixEncoder encoder;
+	uint8_t n = 0;
+
+	*included = 0;
+
+	if (encoder.begin(buff, len) == false)
+		return 0;
+
+	while (first + n < count && n < batchSize)
+	{
+		if (encoder.add(*peek(first + n)) == false)
+			break;					// no room left for this fix
+
+		n++;
+	}
+
+	*included = n;
+	return encoder.end();
+}
+
+
+/**** Statistics ****/
+
+uint16_t FixQueue::getDroppedCount()
+{
+	return droppedCount;
+}
@@ -1,530 +1,1675 @@
-/*
- * GPRS.h
- *
- * Author: Karim Bouanane
- */ 
-
-#include "GPRS.h"
-
-SWUART serialGPRS;
-
-
-// Debugging function
-
-inline void DebugPulse(uint8_t count)
-{
-	while (count--)
-	{
-		PORTD |= _BV(7);
-		PORTD &= ~_BV(7);
-	}
-}
-
-
-/**** A9 module ****/
-
-void GPRS::initSerial()
-{
-	serialGPRS.init(9600);
-	
-	// I already configured manually some parameters and stored them in a defined profile.
-	// This profile is automatically restored after power-up, here they are command that :
-	// I used:
-	// AT+IPR = 9600		Change baud rate
-	// AT+CMGF = 1			SMS Message in text format
-}
-
-
-uint8_t GPRS::softReset()
-{
-	// SUCCESS		OK
-	//
-	// ERROR		NONE
-	//				
-		
-	uint8_t status;
-	
-	status = sendAT("AT+RST=1", "OK\r\n", 2000, 2);	// send command and catch error if there is one 
-	
-	if (status == GPRS_SUCCESS_REPLY)
-	{
-		waitReady();					// wait for the module till it finishes the restart
-	}
-	
-	return status;	
-}
-
-
-uint8_t GPRS::restart()
-{
-	// SUCCESS		OK
-	//
-	// ERROR		NONE
-	//				
-		
-	uint8_t status;
-	
-	status = sendAT("AT+RST=2", "OK\r\n", 2000, 2);
-	
-	if (status == GPRS_SUCCESS_REPLY)
-	{
-		waitReady();					// wait for the module till it finishes the restart
-	}
-	
-	return status;
-}
-
-
-uint8_t GPRS::waitReady()
-{
-	uint8_t status;
-	
-	status = waitResponse("READY", 45000);	
-	
-	if(status != GPRS_SUCCESS_REPLY)					
-	{
-		if(isSIMInserted() != GPRS_SUCCESS_REPLY)
-		{
-			status = NO_SIM_CARD;
-		}
-		else if(isPINUnlocked() != GPRS_SUCCESS_REPLY)
-		{
-			status = PIN_REQUIRED;
-		}
-		else if(waitGSMReg() != GPRS_SUCCESS_REPLY)
-		{
-			status = GSM_REGISTERATION_FAIL;
-		}
-		else
-			status = GPRS_SUCCESS_REPLY;
-	}
-		
-	_delay_ms(100);			// delay between the sending of commands
-	return status;
-}
-
-
-uint8_t GPRS::isConnected()
-{
-	// SUCCESS		OK
-	//
-	// ERROR		NONE
-	//				
-	
-	if(sendAT("AT", "OK\r\n", 2000, 3) != GPRS_SUCCESS_REPLY)
-		return GPRS_DISCONNECTED;
-	
-	return GPRS_SUCCESS_REPLY;
-}
-
-
-uint8_t GPRS::sleep(SleepMode type)
-{
-	switch(type)
-	{
-		case Mode_normal:
-			return sendAT("AT+SLEEP=0", "OK\r\n", 2000, 2);
-		break;
-		
-		case Mode_gpio_power_down:
-			return sendAT("AT+SLEEP=1", "OK\r\n", 2000, 2);
-		break;
-		
-		case Mode_serial_power_down:
-			return sendAT("AT+SLEEP=2", "OK\r\n", 2000, 2);
-		break;
-	}
-	
-	return 0;
-}
-
-
-/**** AT Command ****/
-
-uint8_t GPRS::sendAT(const char* ATCommand, const char* exptReply, uint32_t timeout, uint8_t retry, bool catchError)
-{
-	uint8_t status;
-	
-	while (retry--)	// retry sending command till we get exptReply
-	{
-		serialGPRS.sendString(ATCommand);	// send AT command
-		serialGPRS.sendString("\r\n");		// send command terminator
-		
-		status = waitResponse(exptReply, timeout, catchError);
-		
-		if (status == GPRS_SUCCESS_REPLY || status == GPRS_ERROR_REPLY)
-		{
-			_delay_ms(100); // delay between the sending of commands
-			return status;	
-		}
-	}
-	
-	return GPRS_TIMEOUT_REACHED;
-}
-
-
-uint8_t GPRS::waitResponse(const char* exptReply, uint32_t timeout, bool catchError)
-{
-	char strcode[5];	// store the code of error
-	uint8_t status;
-	
-	if(catchError)
-	{
-		// findOneOf return 0 if timeout is reached, or 1 if the first message is found, or 2 if the second message is found
-		status = serialGPRS.findOneOf(exptReply, "+CME ERROR", timeout);
-		
-		if(status == GPRS_ERROR_REPLY)					 
-		{
-			serialGPRS.readString(strcode, 5, 50);	// get the error code
-			setErrorCode(atoi(strcode));			// convert strcode to integer and 
-		}
-	}
-	else
-	{
-		// find return 0 if timeout is reached, or 1 if exptReply is found
-		status = serialGPRS.find(exptReply, timeout);
-	}
-	
-	return status;
-}
-
-
-uint16_t GPRS::getErrorCode()
-{
-	return errorCode;
-}
-
-
-void GPRS::setErrorCode(uint16_t code)
-{
-	errorCode = code;
-}
-
-
-/**** SIM Card ****/
-
-uint8_t GPRS::isSIMInserted()
-{
-	// SUCCESS		OK
-	//	
-	// ERROR		NONE
-	//
-	
-	if(sendAT("AT+CCID", "+CCID:", 2000, 2) != GPRS_SUCCESS_REPLY)
-		return NO_SIM_CARD;
-
-	return GPRS_SUCCESS_REPLY;
-}
-
-
-uint8_t GPRS::isPINUnlocked()
-{
-	// SUCCESS		+CPIN: <code>
-	//				code = READY, SIM PIN, SIM PUK, SIM PIN2, SIM PUK2 
-	//
-	// ERROR		NONE
-	//
-	
-	if(sendAT("AT+CPIN?", "+CPIN:READY", 2000, 2) != GPRS_SUCCESS_REPLY)
-		return PIN_REQUIRED;
-	
-	return GPRS_SUCCESS_REPLY;
-}
-
-
-/**** GPRS ****/
-
-uint8_t GPRS::waitGPRSReg()
-{
-	// SUCCESS		+CGREG: n,stat
-	//				n= 0: disable unsolicited result code. 1: enable unsolicited result code. 
-	//				   2: enable location information 
-	//				stat= 0: not registered and not searching. 1: registered home network. 
-	//					  2: not registered and currently searching. 3: registration denied
-	//					  4: unknown. 5: registered roaming 	
-	//				
-	// ERROR		NONE
-	//
-
-	uint8_t status;
-
-	sendAT("AT+CGREG=0", "OK\r\n", 1000, 2);	// disable unsolicited result
-	
-	status = sendAT("AT+CGREG?", "+CGREG: 0,1", 1000, MAX_RETRY);
-
-	if (status != GPRS_SUCCESS_REPLY)
-		return GPRS_REGISTRATION_FAIL;
-
-	return GPRS_SUCCESS_REPLY;
-}
-
-
-uint8_t GPRS::setupPDPContext()
-{
-	// SUCCESS		OK
-	//
-	// ERROR		+CME ERROR: 50							+CME ERROR: 148
-	//				Requested facility not subscribed		Unspecified GPRS error
-	
-	if(sendAT("AT+CGACT=1,1", "OK\r\n", 45000, 5, true) != GPRS_SUCCESS_REPLY)
-		return ACTIVATE_PDPCONTEXT_FAIL;
-		
-	return GPRS_SUCCESS_REPLY;
-}
-
-
-uint8_t GPRS::unsetupPDPContext()
-{
-	// SUCCESS		OK
-	//
-	// ERROR		NONE
-	//
-	
-	if(sendAT("AT+CGACT=0,1", "OK\r\n", 5000, 3, true) != GPRS_SUCCESS_REPLY)
-		return DEACTIVATE_PDPCONTEXT_FAIL;
-	
-	return GPRS_SUCCESS_REPLY;
-}
-
-
-uint8_t GPRS::attachMT()
-{
-	// SUCCESS		OK
-	//
-	// ERROR		COMMAND NO RESPONSE
-	//				in case MT not registered (+CGREG: 0,0)
-	
-	if(sendAT("AT+CGATT=1", "+CGATT:1", 45000, 5, true) != GPRS_SUCCESS_REPLY)
-		return ATTACH_NETWORK_FAIL;
-	
-	return GPRS_SUCCESS_REPLY;
-}
-
-
-uint8_t GPRS::configureAPN(const char *apn)
-{
-	// SUCCESS		OK
-	//
-	// ERROR		+CME ERROR: 53
-	//				Parameters invalid
-	
-	if(unsetupPDPContext() != GPRS_SUCCESS_REPLY)	// Deactivate PDP context, so as to configure it again
-		return DEACTIVATE_PDPCONTEXT_FAIL;
-	
-	serialGPRS.sendString("AT+CGDCONT=1,\"IP\",\"");
-	serialGPRS.sendString(apn);
-	serialGPRS.sendString("\"\r\n");
-	
-	waitResponse("OK\r\n", 3000);
-	
-	_delay_ms(100);
-	return GPRS_SUCCESS_REPLY;
-}
-	
-	
-uint8_t GPRS::activateGPRS(const char* apn)
-{
-	if(waitGSMReg() != GPRS_SUCCESS_REPLY)
-		return GSM_REGISTERATION_FAIL;
-			
-	// wait for gprs registration
-	if(waitGPRSReg() != GPRS_SUCCESS_REPLY)
-		return GPRS_REGISTRATION_FAIL;
-	
-	// subscribe to network	
-	if(attachMT() != GPRS_SUCCESS_REPLY)
-		return ATTACH_NETWORK_FAIL;
-		
-	// configure pdp context
-	if (configureAPN(apn) != GPRS_SUCCESS_REPLY)
-		return DEACTIVATE_PDPCONTEXT_FAIL;
-	
-	// activate pdp context
-	if (setupPDPContext() != GPRS_SUCCESS_REPLY)
-		return ACTIVATE_PDPCONTEXT_FAIL;
-	
-	return GPRS_SUCCESS_REPLY;
-}
-
-
-/**** HTTP ****/
-
-uint8_t GPRS::send_HTTP_POSTRequest(const char* httpURL, const char* contentType, const char* postData, uint8_t retry)
-{
-	// Format of command: AT+HTTPPOST = <url>, <content_type>, <body_content>
-
-	// SUCCESS		OK
-	//
-	// ERROR		+CME ERROR: 53
-	//				Sim card or Dns fail
-	
-	uint8_t status = HTTP_SENDING_ERROR;
-	uint8_t found;
-	char codeStr[4];
-	uint16_t codeInt;
-	char temp;
-		
-	while(retry--) 
-	{
-		DebugPulse(1);
-		
-		serialGPRS.sendString("AT+HTTPPOST= \"");
-		serialGPRS.sendString(httpURL);
-		serialGPRS.sendString("\" , \"");
-		serialGPRS.sendString(contentType);
-		serialGPRS.sendString("\" , \"");
-		serialGPRS.sendString(postData);
-		serialGPRS.sendString("\" \r\n");
-	
-		found = serialGPRS.findOneOf("HTTP/1.1  ", "+CME ERROR", 120000);
-		DebugPulse(2);
-		
-		if(found == 1)
-		{	
-			serialGPRS.readString(codeStr, 4,  50);	
-			codeInt = atoi(codeStr);
-			
-			while(serialGPRS.read(&temp, 50) != false);	// read the whole response
-			
-			if(codeInt >= 200 && codeInt <= 299)
-			{
-				status = GPRS_SUCCESS_REPLY;		
-				break;
-			}
-			
-			else if(codeInt >= 400 && codeInt <= 499)
-			{
-				status = HTTP_CLIENT_ERROR;
-			}
-			
-			else if(codeInt >= 500 && codeInt <= 599)
-			{
-				status = HTTP_SERVER_ERRORS;
-			}
-			
-			else
-			{
-				status = HTTP_UNKNOWN_ERROR;
-			}
-
-
-		}
-		else
-		{
-			status = HTTP_SENDING_ERROR;
-			break;
-		}
-	
-		_delay_ms(100);
-	
-	}
-	
-	_delay_ms(100);
-	return status;
-}
-
-
-/**** GSM ****/
-
-uint8_t GPRS::waitGSMReg()
-{
-	// SUCCESS		+CREG: n,stat
-	//				n= 0: disable unsolicited result code. 1: enable unsolicited result code.
-	//				   2: enable location information
-	//				stat= 0: not registered and not searching. 1: registered home network.
-	//					  2: not registered and currently searching. 3: registration denied
-	//					  4: unknown. 5: registered roaming
-	//
-	// ERROR		NONE
-	//
-
-	uint8_t status;
-	//char code;
-	
-	sendAT("AT+CREG=0","OK\r\n",1000,2);	// Disable network registration unsolicited result
-	
-	status = sendAT("AT+CREG?", "+CREG: 0,1", 2000, MAX_RETRY);
-	
-	if (status != GPRS_SUCCESS_REPLY)
-		return GSM_REGISTERATION_FAIL;
-	
-	return GPRS_SUCCESS_REPLY;
-}
-
-
-uint8_t GPRS::setSMSTextFormat()
-{
-	// SUCCESS		OK
-	//
-	// ERROR		NONE
-	//
-	
-	return sendAT("AT+CMGF=1", "OK\r\n", 2000, 2);
-}
-
-
-uint8_t GPRS::sendSMS(const char* phone_number, const char* message)
-{
-	// SUCCESS		+CMGS: 1						+CMGS: 2				+CMGS: 3
-	//				phone number isn't allowed		successful sending		
-	//
-	// ERROR		+CMS ERROR						COMMAND NO RESPONSE
-	//				failing to send message			if 0x1A is ignored
-	
-	uint8_t status;
-
-	serialGPRS.sendString("AT+CMGS=");
-	serialGPRS.send('\"');
-	serialGPRS.sendString(phone_number);
-	serialGPRS.sendString("\"\r\n");
-	
-	waitResponse(">", 1000);
-	_delay_ms(50);
-	
-	serialGPRS.sendString(message);
-	serialGPRS.send(0x1A);
-	
-	status = serialGPRS.findOneOf("+CMS ERROR", "+CMGS:", 45000);
-	
-	if(status != 2)
-		status = SMS_SENDING_ERROR;
-	else
-		status = GPRS_SUCCESS_REPLY;
-	
-	_delay_ms(100);
-	return status;
-}
-
-
-/**** Balance ****/
-
-uint8_t GPRS::checkBalance(const char* code)
-{
-	// iam code #580#
-	// orange code #554#
-		
-	// SUCCESS		OK
-	//
-	// ERROR		+CME ERROR: 15790320 			+CUSD: 2
-	//												session closed
-	
-	uint8_t status;
-
-	serialGPRS.sendString("AT+CUSD=1,\"");
-	serialGPRS.sendString(code);
-	serialGPRS.sendString("\",15\r\n");
-	
-	status = serialGPRS.findOneOf("+CUSD: 1", "+CUSD: 2", 6000);
-	
-	if(status != 1)
-		status = CHECK_BALANCE_ERROR;
-	else
-		status = GPRS_SUCCESS_REPLY;
-	
-	_delay_ms(500);
-	return status;
-}
-
-
-/**** Location ****/
-
+/*
+ * GPRS.h
+ *
+ * Author: Karim Bouanane
+ */ 
+
+#include <avr/pgmspace.h>
+#include "GPRS.h"
+
+GPRS_SERIAL serialGPRS;
+
+SWUART_CHECK_BAUD(GPRS_BAUD);
+SWUART_CHECK_BAUD(GPRS_PROFILE_BAUD);
+
+// a reply is watched together with the three error replies
+static_assert(MATCHER_MAX_PATTERNS >= 4, "the matcher must watch four patterns at the same time");
+
+
+// Debugging function
+
+inline void DebugPulse(uint8_t count)
+{
+	while (count--)
+	{
+		PORTD |= _BV(7);
+		PORTD &= ~_BV(7);
+	}
+}
+
+
+GPRS::GPRS()
+	: errorCode(0)
+	, atHead(0)
+	, atCount(0)
+	, atState(AT_IDLE)
+	, atResult(GPRS_SUCCESS_REPLY)
+	, urcLength(0)
+{
+	modemState.gsmReg = REG_UNKNOWN;
+	modemState.gprsReg = REG_UNKNOWN;
+	modemState.sim = SIM_UNKNOWN;
+	modemState.smsIndex = 0;
+	modemState.smsReceived = false;
+	modemState.socketOpen = false;
+	modemState.socketUDP = false;
+	
+	udpAckSeq = 0;
+	udpAckBitmap = 0;
+	udpAckReceived = false;
+	
+	powerMode = Mode_normal;
+	wakeStep = 0;
+	wakeStart = 0;
+	wakeLatency = 0;
+	maxWakeLatency = 0;
+	
+	baudRate = GPRS_PROFILE_BAUD;
+}
+
+
+/**** A9 module ****/
+
+void GPRS::initSerial()
+{
+	serialGPRS.init(GPRS_BAUD);
+	baudRate = GPRS_BAUD;
+	
+#ifdef GPRS_WAKE_PIN
+	PORTD |= _BV(GPRS_WAKE_PIN);		// idle high
+	DDRD |= _BV(GPRS_WAKE_PIN);
+#endif
+	
+	// I already configured manually some parameters and stored them in a defined profile.
+	// This profile is automatically restored after power-up, here they are command that :
+	// I used:
+	// AT+IPR = 9600		Change baud rate
+	// AT+CMGF = 1			SMS Message in text format
+	
+#if GPRS_BAUD != GPRS_PROFILE_BAUD
+	// the modem is still at the negotiated rate when only the MCU was reset,
+	// else it is at the rate of its profile and moved to GPRS_BAUD. A modem
+	// still starting up is moved once it is ready, by waitReady()
+	if (sendAT("AT", "OK\r\n", 300, 2) != GPRS_SUCCESS_REPLY)
+	{
+		serialGPRS.setBaud(GPRS_PROFILE_BAUD);
+		baudRate = GPRS_PROFILE_BAUD;
+		
+		setBaud(GPRS_BAUD);
+	}
+#endif
+}
+
+
+// AT+IPR is answered at the current rate, then the modem is checked at the
+// new one. It is not saved in the profile, a restart goes back to GPRS_PROFILE_BAUD
+uint8_t GPRS::setBaud(uint32_t baud)
+{
+	// SUCCESS		OK at the new rate
+	//
+	// ERROR		ERROR, the rate is not changed
+	//				TIMEOUT, the rate is not changed
+	
+	char command[16] = "AT+IPR=";
+	uint32_t previous = baudRate;
+	uint8_t status;
+	
+	if (swuartBaudSupported(baud) == false)
+		return GPRS_ERROR_REPLY;
+	
+	ultoa(baud, command + 7, 10);
+	
+	status = sendAT(command, "OK\r\n", 1000, 2, true);
+	
+	if (status != GPRS_SUCCESS_REPLY)
+		return status;
+	
+	serialGPRS.setBaud(baud);
+	baudRate = baud;
+	
+	status = sendAT("AT", "OK\r\n", 500, 3);
+	
+	if (status != GPRS_SUCCESS_REPLY)
+	{
+		serialGPRS.setBaud(previous);
+		baudRate = previous;
+	}
+	
+	return status;
+}
+
+
+uint32_t GPRS::getBaud()
+{
+	return baudRate;
+}
+
+
+uint8_t GPRS::softReset()
+{
+	// SUCCESS		OK
+	//
+	// ERROR		NONE
+	//				
+		
+	uint8_t status;
+	
+	status = sendAT("AT+RST=1", "OK\r\n", 2000, 2);	// send command and catch error if there is one 
+	
+	if (status == GPRS_SUCCESS_REPLY)
+	{
+		serialGPRS.setBaud(GPRS_PROFILE_BAUD);	// the modem starts again at the rate of its profile
+		baudRate = GPRS_PROFILE_BAUD;
+		
+		waitReady();					// wait for the module till it finishes the restart
+	}
+	
+	return status;	
+}
+
+
+uint8_t GPRS::restart()
+{
+	// SUCCESS		OK
+	//
+	// ERROR		NONE
+	//				
+		
+	uint8_t status;
+	
+	status = sendAT("AT+RST=2", "OK\r\n", 2000, 2);
+	
+	if (status == GPRS_SUCCESS_REPLY)
+	{
+		serialGPRS.setBaud(GPRS_PROFILE_BAUD);	// the modem starts again at the rate of its profile
+		baudRate = GPRS_PROFILE_BAUD;
+		
+		waitReady();					// wait for the module till it finishes the restart
+	}
+	
+	return status;
+}
+
+
+uint8_t GPRS::waitReady()
+{
+	uint8_t status;
+	
+	status = waitResponse("READY", 45000);	
+	
+	if(status != GPRS_SUCCESS_REPLY)					
+	{
+		if(isSIMInserted() != GPRS_SUCCESS_REPLY)
+		{
+			status = NO_SIM_CARD;
+		}
+		else if(isPINUnlocked() != GPRS_SUCCESS_REPLY)
+		{
+			status = PIN_REQUIRED;
+		}
+		else if(waitGSMReg() != GPRS_SUCCESS_REPLY)
+		{
+			status = GSM_REGISTERATION_FAIL;
+		}
+		else
+			status = GPRS_SUCCESS_REPLY;
+	}
+		
+	_delay_ms(100);			// delay between the sending of commands
+	
+	if (baudRate != GPRS_BAUD)
+		setBaud(GPRS_BAUD);	// the serial link stays at the profile rate if it fails
+	
+	return status;
+}
+
+
+uint8_t GPRS::isConnected()
+{
+	// SUCCESS		OK
+	//
+	// ERROR		NONE
+	//				
+	
+	if(sendAT("AT", "OK\r\n", 2000, 3) != GPRS_SUCCESS_REPLY)
+		return GPRS_DISCONNECTED;
+	
+	return GPRS_SUCCESS_REPLY;
+}
+
+
+uint8_t GPRS::sleep(SleepMode type)
+{
+	uint8_t status = 0;
+	
+	// a sleeping modem is woken up first, which leaves the sleep mode
+	if (type == Mode_normal)
+		return wakeup();
+	
+#ifndef GPRS_WAKE_PIN
+	if (type == Mode_gpio_power_down)
+		return GPRS_ERROR_REPLY;			// nothing could wake it up
+#endif
+	
+	switch(type)
+	{
+		case Mode_normal:
+		break;
+		
+		case Mode_gpio_power_down:
+			status = sendAT("AT+SLEEP=1", "OK\r\n", 2000, 2);
+		break;
+		
+		case Mode_serial_power_down:
+			status = sendAT("AT+SLEEP=2", "OK\r\n", 2000, 2);
+		break;
+	}
+	
+	if (status == GPRS_SUCCESS_REPLY)
+		powerMode = type;
+	
+	return status;
+}
+
+
+// wake the modem up and leave the sleep mode, nothing is sent meanwhile
+uint8_t GPRS::wakeup()
+{
+	uint8_t result;
+	
+	if (powerMode == Mode_normal)
+		return GPRS_SUCCESS_REPLY;
+	
+	finishQueue();					// the queued commands wake it up themselves
+	
+	if (powerMode == Mode_normal)
+		return GPRS_SUCCESS_REPLY;
+	
+	result = atResult;				// result of the queue, kept for its owner
+	
+	startWakeup();
+	
+	while (atState == AT_WAKE)
+		pollWakeup();
+	
+	while (poll() == GPRS_BUSY);	// guard delay, and the failure is reported here only
+	
+	atResult = result;
+	
+	return powerMode == Mode_normal ? GPRS_SUCCESS_REPLY : MODEM_WAKE_FAIL;
+}
+
+
+bool GPRS::isAsleep()
+{
+	return powerMode != Mode_normal;
+}
+
+
+// ms from the wake up to the modem ready, last and largest measures
+uint32_t GPRS::getWakeLatency()
+{
+	return wakeLatency;
+}
+
+
+uint32_t GPRS::getMaxWakeLatency()
+{
+	return maxWakeLatency;
+}
+
+
+// The wake up is a handshake : the optional pin is pulsed, then "AT" is
+// sent every GPRS_WAKE_RETRY ms till the modem answers, the first bytes
+// being lost while it wakes up. "AT+SLEEP=0" then keeps it awake.
+
+void GPRS::startWakeup()
+{
+#ifdef GPRS_WAKE_PIN
+	PORTD &= ~_BV(GPRS_WAKE_PIN);
+	_delay_ms(GPRS_WAKE_PULSE);
+	PORTD |= _BV(GPRS_WAKE_PIN);
+#endif
+	
+	atMatcher.clear();
+	atMatcher.add("OK\r\n");
+	atMatcher.reset();
+	
+	serialGPRS.sendString("AT\r\n");
+	
+	wakeStep = 0;
+	wakeStart = timerNow();
+	atTimestamp = wakeStart;
+	atState = AT_WAKE;
+}
+
+
+void GPRS::pollWakeup()
+{
+	char data;
+	
+	while (serialGPRS.isAvailable())
+	{
+		serialGPRS.read(&data);
+		processByte(data);
+		
+		if (atMatcher.feed(data) == MATCHER_NO_MATCH)
+			continue;
+		
+		if (wakeStep == 0)
+		{
+			serialGPRS.sendString("AT+SLEEP=0\r\n");
+			atMatcher.reset();
+			atTimestamp = timerNow();
+			wakeStep = 1;
+			continue;
+		}
+		
+		powerMode = Mode_normal;
+		wakeLatency = timerNow() - wakeStart;
+		
+		if (wakeLatency > maxWakeLatency)
+			maxWakeLatency = wakeLatency;
+		
+		atTimestamp = timerNow();
+		atState = AT_GUARD;
+		return;
+	}
+	
+	if (timerNow() - wakeStart > GPRS_WAKE_TIMEOUT)
+	{
+		atResult = MODEM_WAKE_FAIL;			// the queued commands are dropped
+		atCount = 0;
+		atState = AT_IDLE;
+	}
+	else if (wakeStep == 0 && timerNow() - atTimestamp >= GPRS_WAKE_RETRY)
+	{
+		serialGPRS.sendString("AT\r\n");
+		atTimestamp = timerNow();
+	}
+}
+
+
+/**** AT Command ****/
+
+// run the queued commands to their end. Their result is kept, the owner
+// of the queue still gets it from its next poll()
+void GPRS::finishQueue()
+{
+	uint8_t result;
+	
+	while ((result = poll()) == GPRS_BUSY);
+	
+	atResult = result;
+}
+
+
+// before a command written on the serial line by a blocking method, the
+// queued commands finish and the modem is woken up, it never gets a command asleep
+uint8_t GPRS::prepareCommand()
+{
+	finishQueue();					// let the queued commands finish first
+	
+	if (wakeup() != GPRS_SUCCESS_REPLY)
+		return MODEM_WAKE_FAIL;
+	
+	return GPRS_SUCCESS_REPLY;
+}
+
+
+uint8_t GPRS::sendAT(const char* ATCommand, const char* exptReply, uint32_t timeout, uint8_t retry, bool catchError)
+{
+	uint8_t status;
+	
+	status = prepareCommand();
+	
+	if (status != GPRS_SUCCESS_REPLY)
+		return status;
+	
+	while (retry--)	// retry sending command till we get exptReply
+	{
+		serialGPRS.sendString(ATCommand);	// send AT command
+		serialGPRS.sendString("\r\n");		// send command terminator
+		
+		status = waitResponse(exptReply, timeout, catchError);
+		
+		if (status == GPRS_SUCCESS_REPLY || status == GPRS_ERROR_REPLY)
+		{
+			_delay_ms(100); // delay between the sending of commands
+			return status;	
+		}
+	}
+	
+	return GPRS_TIMEOUT_REACHED;
+}
+
+
+uint8_t GPRS::waitResponse(const char* exptReply, uint32_t timeout, bool catchError)
+{
+	char strcode[6];	// store the code of error
+	StreamMatcher& matcher = atMatcher;		// free, the blocking commands wait for the queue to finish
+	
+	// all replies are watched in one pass, the first one received ends the wait.
+	// A reply too long for the matcher would shift the indices below, an error
+	// would then be taken for the expected reply
+	matcher.clear();
+	
+	if (matcher.add(exptReply) == false)	// 1
+	{
+		setErrorCode(0);
+		return GPRS_ERROR_REPLY;	// sending it again gives the same result
+	}
+	
+	matcher.add("+CME ERROR:");		// 2
+	matcher.add("+CMS ERROR:");		// 3
+	matcher.add("\r\nERROR");		// 4, the colon of the extended errors is not reached yet when "ERROR" ends
+	
+	switch(waitAny(matcher, timeout))
+	{
+		case 0:
+			return GPRS_TIMEOUT_REACHED;
+		
+		case 1:
+			return GPRS_SUCCESS_REPLY;
+			
+		case 2:
+		case 3:
+			readModemLine(strcode, sizeof(strcode) - 1, 50);			// get the error code
+			setErrorCode(atoi(strcode));								// convert strcode to integer
+		break;
+		
+		default:
+			setErrorCode(0);
+		break;
+	}
+	
+	// an error reply ends the retries only for the commands catching errors,
+	// the others are sent again right away instead of waiting for the timeout
+	return catchError ? GPRS_ERROR_REPLY : UNINDENTIFIED_ERROR;
+}
+
+
+uint16_t GPRS::getErrorCode()
+{
+	return errorCode;
+}
+
+
+void GPRS::setErrorCode(uint16_t code)
+{
+	errorCode = code;
+}
+
+
+/**** Asynchronous AT Command ****/
+
+// The queued commands are sent one after the other by poll(), which never
+// waits for the modem. It must be called from the main loop till it stops
+// returning GPRS_BUSY, then it returns the status of the first command
+// that failed, or GPRS_SUCCESS_REPLY.
+
+bool GPRS::queueAT(const ATCommand& command)
+{
+	if (atCount >= AT_QUEUE_SIZE)
+		return false;
+	
+	atQueue[(atHead + atCount) % AT_QUEUE_SIZE] = command;
+	atCount++;
+	
+	return true;
+}
+
+
+// same as queueAT for a command kept in flash, the queued copy is returned
+// so the arguments known at run time can be set. NULL if the queue is full
+ATCommand* GPRS::queueAT_P(const ATCommand* command)
+{
+	ATCommand* queued;
+	
+	if (atCount >= AT_QUEUE_SIZE)
+		return NULL;
+	
+	queued = &atQueue[(atHead + atCount) % AT_QUEUE_SIZE];
+	memcpy_P(queued, command, sizeof(ATCommand));
+	atCount++;
+	
+	return queued;
+}
+
+
+uint8_t GPRS::poll()
+{
+	uint8_t result;
+	uint8_t found;
+	char data;
+	
+	// outside of a reply, the received lines can only be unsolicited results
+	if (atState == AT_IDLE || atState == AT_WAIT_EVENT || atState == AT_GUARD)
+	{
+		while (serialGPRS.isAvailable())
+		{
+			serialGPRS.read(&data);
+			processByte(data);
+		}
+	}
+	
+	switch (atState)
+	{
+		case AT_IDLE:
+		
+			if (atCount == 0)
+			{
+				result = atResult;				// report the result once
+				atResult = GPRS_SUCCESS_REPLY;
+				return result;
+			}
+			
+			// no command is sent to a sleeping modem
+			if (powerMode != Mode_normal)
+			{
+				startWakeup();
+				return GPRS_BUSY;
+			}
+			
+			atRetry = atQueue[atHead].retry;
+			startCommand();
+			
+		break;
+		
+		case AT_WAKE:
+		
+			pollWakeup();
+			
+		break;
+		
+		case AT_WAIT_REPLY:
+		
+			while (serialGPRS.isAvailable())
+			{
+				serialGPRS.read(&data);
+				processByte(data);
+				found = atMatcher.feed(data);
+				
+				if (found == MATCHER_NO_MATCH)
+					continue;
+				
+				atStatus = (found == 1) ? GPRS_SUCCESS_REPLY : GPRS_ERROR_REPLY;
+				
+				// the rest of the line holds the error code or the data of the reply
+				if (found == 2 || found == 3 || (found == 1 && (atQueue[atHead].flags & AT_CAPTURE_REPLY)))
+				{
+					atReplyLength = 0;
+					atTimestamp = timerNow();
+					atState = AT_CAPTURE;
+				}
+				else
+				{
+					finishCommand(atStatus);
+				}
+				
+				return GPRS_BUSY;
+			}
+			
+			if (timerNow() - atTimestamp > atQueue[atHead].timeout)
+				finishCommand(GPRS_TIMEOUT_REACHED);
+			
+		break;
+		
+		case AT_CAPTURE:
+		
+			while (serialGPRS.isAvailable())
+			{
+				serialGPRS.read(&data);
+				processByte(data);
+				
+				if (data == '\n' || atReplyLength >= AT_REPLY_SIZE - 1)
+				{
+					finishCommand(atStatus);
+					return GPRS_BUSY;
+				}
+				
+				atReply[atReplyLength++] = data;
+				atReply[atReplyLength] = 0;
+			}
+			
+			if (timerNow() - atTimestamp > AT_CAPTURE_TIMEOUT)
+				finishCommand(atStatus);
+			
+		break;
+		
+		case AT_WAIT_EVENT:
+		
+			if (isEventSet((ModemEvent)atQueue[atHead].event))
+				finishCommand(GPRS_SUCCESS_REPLY);
+			else if (timerNow() - atTimestamp > atQueue[atHead].timeout)
+				finishCommand(GPRS_TIMEOUT_REACHED);
+			
+		break;
+		
+		case AT_GUARD:
+		
+			// delay between the sending of commands
+			if (timerNow() - atTimestamp >= AT_COMMAND_DELAY)
+				atState = AT_IDLE;
+			
+		break;
+	}
+	
+	return GPRS_BUSY;
+}
+
+
+bool GPRS::isBusy()
+{
+	return atCount != 0 || atState != AT_IDLE;
+}
+
+
+void GPRS::abortQueue()
+{
+	atCount = 0;
+	atState = AT_IDLE;
+	atResult = GPRS_SUCCESS_REPLY;
+}
+
+
+void GPRS::startCommand()
+{
+	ATCommand* command = &atQueue[atHead];
+	const char* format = command->format;
+	uint8_t arg = 0;
+	
+	atReply[0] = 0;
+	atTimestamp = timerNow();
+	
+	// no command to send, wait for the modem state to change
+	if (format == NULL)
+	{
+		atState = AT_WAIT_EVENT;
+		return;
+	}
+	
+	// the command fails without being sent when its reply is too long for the
+	// matcher, the error replies would be taken for the expected one
+	atMatcher.clear();
+	
+	if (atMatcher.add(command->exptReply) == false)	// 1
+	{
+		atRetry = 1;						// sending it again gives the same result
+		finishCommand(GPRS_ERROR_REPLY);
+		return;
+	}
+	
+	atMatcher.add("+CME ERROR:");			// 2
+	atMatcher.add("+CMS ERROR:");			// 3
+	atMatcher.add("\r\nERROR");			// 4
+	atMatcher.reset();
+	
+	// send the command, replacing each '%' by the next argument
+	while (*format != '\0')
+	{
+		if (*format == '%' && arg < AT_MAX_ARGS)
+			serialGPRS.sendString(command->args[arg++]);
+		else
+			serialGPRS.send(*format);
+		
+		format++;
+	}
+	
+	if ((command->flags & AT_RAW) == 0)
+		serialGPRS.sendString("\r\n");	// send command terminator
+	
+	atState = AT_WAIT_REPLY;
+}
+
+
+void GPRS::finishCommand(uint8_t status)
+{
+	ATCommand* command = &atQueue[atHead];
+	bool caught = (status == GPRS_ERROR_REPLY) && (command->flags & AT_CATCH_ERROR);
+	
+	if (status == GPRS_ERROR_REPLY)
+		setErrorCode(atoi(atReply));		// the captured line starts with the error code
+	
+	if (command->handler != NULL)
+		status = command->handler(status, atReply);
+	
+	// retry sending command till we get exptReply
+	if (status != GPRS_SUCCESS_REPLY && caught == false && --atRetry != 0)
+	{
+		startCommand();
+		return;
+	}
+	
+	if (status != GPRS_SUCCESS_REPLY && (command->flags & AT_OPTIONAL) == 0)
+	{
+		atResult = command->failCode != 0 ? command->failCode : status;
+		atCount = 0;						// drop the rest of the queue
+	}
+	else
+	{
+		atHead = (atHead + 1) % AT_QUEUE_SIZE;
+		atCount--;
+	}
+	
+	atTimestamp = timerNow();
+	atState = AT_GUARD;
+}
+
+
+/**** Unsolicited Result Code ****/
+
+// Every byte received from the modem goes through processByte, whichever
+// function reads it, so the modem state is always up to date. Solicited
+// replies of the same form (AT+CREG? ...) update the state as well.
+
+const ModemState* GPRS::getModemState()
+{
+	return &modemState;
+}
+
+
+bool GPRS::isEventSet(ModemEvent event)
+{
+	switch (event)
+	{
+		case EVENT_GSM_REGISTERED:
+			return modemState.gsmReg == REG_HOME || modemState.gsmReg == REG_ROAMING;
+		
+		case EVENT_GPRS_REGISTERED:
+			return modemState.gprsReg == REG_HOME || modemState.gprsReg == REG_ROAMING;
+		
+		case EVENT_SIM_READY:
+			return modemState.sim == SIM_READY;
+		
+		case EVENT_SMS_RECEIVED:
+			return modemState.smsReceived;
+		
+		default:
+			return false;
+	}
+}
+
+
+uint8_t GPRS::waitEvent(ModemEvent event, uint32_t timeout)
+{
+	uint32_t prev = timerNow();
+	char data;
+	
+	while (isEventSet(event) == false)
+	{
+		if (readModem(&data, prev, timeout) == false)
+			return GPRS_TIMEOUT_REACHED;
+	}
+	
+	return GPRS_SUCCESS_REPLY;
+}
+
+
+bool GPRS::getNewSMS(uint8_t* index)
+{
+	if (modemState.smsReceived == false)
+		return false;
+	
+	*index = modemState.smsIndex;
+	modemState.smsReceived = false;
+	return true;
+}
+
+
+bool GPRS::readModem(char* data, uint32_t prev, uint32_t timeout)
+{
+	while (serialGPRS.isAvailable() == false)
+	{
+		if (timerNow() - prev > timeout)	// be sure not exceed the timeout
+			return false;					// timeout is reached
+	}
+	
+	serialGPRS.read(data);
+	processByte(*data);
+	return true;
+}
+
+
+size_t GPRS::readModemLine(char* buff, size_t len, uint32_t timeout)
+{
+	uint32_t prev = timerNow();
+	size_t i = 0;
+	
+	while (i < len && readModem(&buff[i], prev, timeout))
+	{
+		if (buff[i++] == '\n')		// include terminator in buffer
+			break;
+	}
+	
+	buff[i] = 0;	// close array
+	return i;
+}
+
+
+uint8_t GPRS::waitAny(StreamMatcher& matcher, uint32_t timeout)
+{
+	uint32_t prev = timerNow();
+	uint8_t found;
+	char data;
+	
+	matcher.reset();
+	
+	do
+	{
+		if (readModem(&data, prev, timeout) == false)
+			return MATCHER_NO_MATCH;	// timeout is reached
+		
+		found = matcher.feed(data);
+		
+	} while (found == MATCHER_NO_MATCH);
+	
+	return found;
+}
+
+
+uint8_t GPRS::waitOneOf(const char* target1, const char* target2, uint32_t timeout)
+{
+	StreamMatcher& matcher = atMatcher;		// free, the blocking commands wait for the queue to finish
+	
+	matcher.clear();
+	
+	if (matcher.add(target1) == false || matcher.add(target2) == false)
+		return MATCHER_NO_MATCH;	// targets are too long for the matcher, read as a failure
+	
+	return waitAny(matcher, timeout);
+}
+
+
+void GPRS::processByte(char data)
+{
+	if (data == '\n')
+	{
+		urcLine[urcLength] = 0;
+		handleLine();
+		urcLength = 0;
+	}
+	else if (data != '\r' && urcLength < URC_LINE_SIZE - 1)
+	{
+		urcLine[urcLength++] = data;	// longer lines are truncated, URC prefixes are short
+	}
+}
+
+
+// "+CREG: <stat>" when unsolicited, "+CREG: <n>,<stat>" as a reply to AT+CREG?
+static uint8_t parseRegistration(const char* params)
+{
+	const char* comma = strchr(params, ',');
+	
+	if (comma != NULL && comma[1] >= '0' && comma[1] <= '9')
+		return atoi(comma + 1);
+	
+	return atoi(params);
+}
+
+
+// map the status code of an HTTP response to a status
+static uint8_t httpStatus(uint16_t codeInt)
+{
+	if(codeInt >= 200 && codeInt <= 299)
+		return GPRS_SUCCESS_REPLY;
+	
+	if(codeInt >= 400 && codeInt <= 499)
+		return HTTP_CLIENT_ERROR;
+	
+	if(codeInt >= 500 && codeInt <= 599)
+		return HTTP_SERVER_ERRORS;
+	
+	return HTTP_UNKNOWN_ERROR;
+}
+
+
+void GPRS::handleLine()
+{
+	const char* params;
+	
+	if (strncmp(urcLine, "+CREG:", 6) == 0)
+	{
+		modemState.gsmReg = parseRegistration(urcLine + 6);
+	}
+	else if (strncmp(urcLine, "+CGREG:", 7) == 0)
+	{
+		modemState.gprsReg = parseRegistration(urcLine + 7);
+	}
+	else if (strncmp(urcLine, "+CMTI:", 6) == 0)
+	{
+		// +CMTI: <mem>,<index>
+		params = strchr(urcLine, ',');
+		
+		if (params != NULL)
+		{
+			modemState.smsIndex = atoi(params + 1);
+			modemState.smsReceived = true;
+		}
+	}
+	else if (strncmp(urcLine, "+CPIN:", 6) == 0)
+	{
+		// +CPIN: <code>
+		params = urcLine + 6;
+		
+		while (*params == ' ')
+			params++;
+		
+		if (strncmp(params, "READY", 5) == 0)
+			modemState.sim = SIM_READY;
+		else if (strncmp(params, "SIM PIN", 7) == 0)
+			modemState.sim = SIM_PIN;
+		else if (strncmp(params, "SIM PUK", 7) == 0)
+			modemState.sim = SIM_PUK;
+		else
+			modemState.sim = SIM_NOT_INSERTED;
+	}
+	else if (strncmp(urcLine, "CONNECT OK", 10) == 0 || strncmp(urcLine, "ALREADY CONNECT", 15) == 0)
+	{
+		modemState.socketOpen = true;
+	}
+	else if (strncmp(urcLine, "CLOSED", 6) == 0 || strncmp(urcLine, "+TCPCLOSED", 10) == 0 ||
+			 strncmp(urcLine, "CONNECT FAIL", 12) == 0)
+	{
+		modemState.socketOpen = false;
+	}
+	else if (modemState.socketOpen && modemState.socketUDP)
+	{
+		// acknowledgment datagram "+CIPRCV:<len>,a=<seq>&b=<bitmap>", see UDPWindow.h
+		params = strstr(urcLine, "a=");
+		
+		if (strncmp(urcLine, "+CIPRCV:", 8) == 0 && params != NULL)
+		{
+			udpAckSeq = atol(params + 2);
+			params = strstr(params, "&b=");
+			udpAckBitmap = params != NULL ? strtoul(params + 3, NULL, 16) : 0;
+			udpAckReceived = true;
+		}
+	}
+	else if (modemState.socketOpen)
+	{
+		// status line of a response, "+CIPRCV:<len>,HTTP/1.1 200 OK" or alone
+		// when several responses came in the same packet
+		params = strstr(urcLine, "HTTP/1.1 ");
+		
+		if (params != NULL)
+			tcpResponses.push(httpStatus(atoi(params + 9)));
+	}
+}
+
+
+/**** SIM Card ****/
+
+uint8_t GPRS::isSIMInserted()
+{
+	// SUCCESS		OK
+	//	
+	// ERROR		NONE
+	//
+	
+	if(sendAT("AT+CCID", "+CCID:", 2000, 2) != GPRS_SUCCESS_REPLY)
+		return NO_SIM_CARD;
+
+	return GPRS_SUCCESS_REPLY;
+}
+
+
+uint8_t GPRS::isPINUnlocked()
+{
+	// SUCCESS		+CPIN: <code>
+	//				code = READY, SIM PIN, SIM PUK, SIM PIN2, SIM PUK2 
+	//
+	// ERROR		NONE
+	//
+	
+	if(sendAT("AT+CPIN?", "+CPIN:READY", 2000, 2) != GPRS_SUCCESS_REPLY)
+		return PIN_REQUIRED;
+	
+	return GPRS_SUCCESS_REPLY;
+}
+
+
+/**** GPRS ****/
+
+uint8_t GPRS::waitGPRSReg()
+{
+	// SUCCESS		+CGREG: stat				(unsolicited result)
+	//				+CGREG: n,stat				(reply to AT+CGREG?)
+	//				n= 0: disable unsolicited result code. 1: enable unsolicited result code. 
+	//				   2: enable location information 
+	//				stat= 0: not registered and not searching. 1: registered home network. 
+	//					  2: not registered and currently searching. 3: registration denied
+	//					  4: unknown. 5: registered roaming 	
+	//				
+	// ERROR		NONE
+	//
+
+	sendAT("AT+CGREG=1", "OK\r\n", 1000, 2);	// enable unsolicited result
+	sendAT("AT+CGREG?", "OK\r\n", 1000, 2);	// the reply refreshes the registration state
+	
+	// registration completes as soon as the network reports it
+	if (waitEvent(EVENT_GPRS_REGISTERED, REGISTRATION_TIMEOUT) != GPRS_SUCCESS_REPLY)
+		return GPRS_REGISTRATION_FAIL;
+
+	return GPRS_SUCCESS_REPLY;
+}
+
+
+uint8_t GPRS::setupPDPContext()
+{
+	// SUCCESS		OK
+	//
+	// ERROR		+CME ERROR: 50							+CME ERROR: 148
+	//				Requested facility not subscribed		Unspecified GPRS error
+	
+	if(sendAT("AT+CGACT=1,1", "OK\r\n", 45000, 5, true) != GPRS_SUCCESS_REPLY)
+		return ACTIVATE_PDPCONTEXT_FAIL;
+		
+	return GPRS_SUCCESS_REPLY;
+}
+
+
+uint8_t GPRS::unsetupPDPContext()
+{
+	// SUCCESS		OK
+	//
+	// ERROR		NONE
+	//
+	
+	if(sendAT("AT+CGACT=0,1", "OK\r\n", 5000, 3, true) != GPRS_SUCCESS_REPLY)
+		return DEACTIVATE_PDPCONTEXT_FAIL;
+	
+	return GPRS_SUCCESS_REPLY;
+}
+
+
+uint8_t GPRS::attachMT()
+{
+	// SUCCESS		OK
+	//
+	// ERROR		COMMAND NO RESPONSE
+	//				in case MT not registered (+CGREG: 0,0)
+	
+	if(sendAT("AT+CGATT=1", "+CGATT:1", 45000, 5, true) != GPRS_SUCCESS_REPLY)
+		return ATTACH_NETWORK_FAIL;
+	
+	return GPRS_SUCCESS_REPLY;
+}
+
+
+uint8_t GPRS::configureAPN(const char *apn)
+{
+	// SUCCESS		OK
+	//
+	// ERROR		+CME ERROR: 53
+	//				Parameters invalid
+	
+	uint8_t status;
+	
+	if(unsetupPDPContext() != GPRS_SUCCESS_REPLY)	// Deactivate PDP context, so as to configure it again
+		return DEACTIVATE_PDPCONTEXT_FAIL;
+	
+	status = prepareCommand();
+	
+	if (status != GPRS_SUCCESS_REPLY)
+		return status;
+	
+	serialGPRS.sendString("AT+CGDCONT=1,\"IP\",\"");
+	serialGPRS.sendString(apn);
+	serialGPRS.sendString("\"\r\n");
+	
+	waitResponse("OK\r\n", 3000);
+	
+	_delay_ms(100);
+	return GPRS_SUCCESS_REPLY;
+}
+	
+	
+uint8_t GPRS::activateGPRS(const char* apn)
+{
+	if(waitGSMReg() != GPRS_SUCCESS_REPLY)
+		return GSM_REGISTERATION_FAIL;
+			
+	// wait for gprs registration
+	if(waitGPRSReg() != GPRS_SUCCESS_REPLY)
+		return GPRS_REGISTRATION_FAIL;
+	
+	// subscribe to network	
+	if(attachMT() != GPRS_SUCCESS_REPLY)
+		return ATTACH_NETWORK_FAIL;
+		
+	// configure pdp context
+	if (configureAPN(apn) != GPRS_SUCCESS_REPLY)
+		return DEACTIVATE_PDPCONTEXT_FAIL;
+	
+	// activate pdp context
+	if (setupPDPContext() != GPRS_SUCCESS_REPLY)
+		return ACTIVATE_PDPCONTEXT_FAIL;
+	
+	return GPRS_SUCCESS_REPLY;
+}
+
+
+bool GPRS::beginActivateGPRS(const char* apn)
+{
+	// same sequence as activateGPRS, run by poll() while the main loop does other work.
+	// The sequence is kept in flash, only the queued copies take RAM
+	
+	static const ATCommand sequence[] PROGMEM =
+	{
+		// format					args		exptReply			timeout	retry		flags			failCode				handler	event
+		{ "AT+CREG=1",				{ NULL },	"OK\r\n",			1000,	2,			AT_OPTIONAL,	0,						NULL,	EVENT_NONE },
+		{ "AT+CREG?",				{ NULL },	"OK\r\n",			1000,	2,			AT_OPTIONAL,	0,						NULL,	EVENT_NONE },
+		{ NULL,						{ NULL },	NULL,				REGISTRATION_TIMEOUT, 1, 0,		GSM_REGISTERATION_FAIL,	NULL,	EVENT_GSM_REGISTERED },
+		{ "AT+CGREG=1",				{ NULL },	"OK\r\n",			1000,	2,			AT_OPTIONAL,	0,						NULL,	EVENT_NONE },
+		{ "AT+CGREG?",				{ NULL },	"OK\r\n",			1000,	2,			AT_OPTIONAL,	0,						NULL,	EVENT_NONE },
+		{ NULL,						{ NULL },	NULL,				REGISTRATION_TIMEOUT, 1, 0,		GPRS_REGISTRATION_FAIL,	NULL,	EVENT_GPRS_REGISTERED },
+		{ "AT+CGATT=1",				{ NULL },	"+CGATT:1",			45000,	5,			AT_CATCH_ERROR,	ATTACH_NETWORK_FAIL,	NULL,	EVENT_NONE },
+		{ "AT+CGACT=0,1",			{ NULL },	"OK\r\n",			5000,	3,			AT_CATCH_ERROR,	DEACTIVATE_PDPCONTEXT_FAIL, NULL,	EVENT_NONE },
+		{ "AT+CGDCONT=1,\"IP\",\"%\"",	{ NULL },	"OK\r\n",			3000,	1,			AT_OPTIONAL,	0,						NULL,	EVENT_NONE },
+		{ "AT+CGACT=1,1",			{ NULL },	"OK\r\n",			45000,	5,			AT_CATCH_ERROR,	ACTIVATE_PDPCONTEXT_FAIL, NULL,	EVENT_NONE },
+	};
+	
+	const uint8_t length = sizeof(sequence) / sizeof(sequence[0]);
+	const uint8_t apnCommand = 8;			// AT+CGDCONT
+	ATCommand* command;
+	
+	if (AT_QUEUE_SIZE - atCount < length)
+		return false;
+	
+	for (uint8_t i = 0; i < length; i++)
+	{
+		command = queueAT_P(&sequence[i]);
+		
+		if (i == apnCommand)
+			command->args[0] = apn;
+	}
+	
+	return true;
+}
+
+
+/**** HTTP ****/
+
+uint8_t GPRS::send_HTTP_POSTRequest(const char* httpURL, const char* contentType, const char* postData, uint8_t retry)
+{
+	// Format of command: AT+HTTPPOST = <url>, <content_type>, <body_content>
+
+	// SUCCESS		OK
+	//
+	// ERROR		+CME ERROR: 53
+	//				Sim card or Dns fail
+	
+	uint8_t status = HTTP_SENDING_ERROR;
+	uint8_t found;
+	char codeStr[4];
+	uint16_t codeInt;
+	char temp;
+	
+	status = prepareCommand();
+	
+	if (status != GPRS_SUCCESS_REPLY)
+		return status;
+		
+	while(retry--) 
+	{
+		DebugPulse(1);
+		
+		serialGPRS.sendString("AT+HTTPPOST= \"");
+		serialGPRS.sendString(httpURL);
+		serialGPRS.sendString("\" , \"");
+		serialGPRS.sendString(contentType);
+		serialGPRS.sendString("\" , \"");
+		serialGPRS.sendString(postData);
+		serialGPRS.sendString("\" \r\n");
+	
+		found = waitOneOf("HTTP/1.1  ", "+CME ERROR", 120000);
+		DebugPulse(2);
+		
+		if(found == 1)
+		{	
+			readModemLine(codeStr, 3, 50);	
+			codeInt = atoi(codeStr);
+			
+			while(readModem(&temp, timerNow(), 50) != false);	// read the whole response
+			
+			if(codeInt >= 200 && codeInt <= 299)
+			{
+				status = GPRS_SUCCESS_REPLY;		
+				break;
+			}
+			
+			else if(codeInt >= 400 && codeInt <= 499)
+			{
+				status = HTTP_CLIENT_ERROR;
+			}
+			
+			else if(codeInt >= 500 && codeInt <= 599)
+			{
+				status = HTTP_SERVER_ERRORS;
+			}
+			
+			else
+			{
+				status = HTTP_UNKNOWN_ERROR;
+			}
+
+
+		}
+		else
+		{
+			status = HTTP_SENDING_ERROR;
+			break;
+		}
+	
+		_delay_ms(100);
+	
+	}
+	
+	_delay_ms(100);
+	return status;
+}
+
+
+// map the status code following "HTTP/1.1  " to a status
+static uint8_t httpReplyHandler(uint8_t status, const char* reply)
+{
+	if (status != GPRS_SUCCESS_REPLY)
+		return HTTP_SENDING_ERROR;
+	
+	return httpStatus(atoi(reply));
+}
+
+
+bool GPRS::beginHTTPPOST(const char* httpURL, const char* contentType, const char* postData, uint8_t retry)
+{
+	// same request as send_HTTP_POSTRequest, run by poll(). The strings must
+	// stay unchanged till poll() stops returning GPRS_BUSY
+	
+	ATCommand command =
+	{
+		"AT+HTTPPOST= \"%\" , \"%\" , \"%\" ",
+		{ httpURL, contentType, postData },
+		"HTTP/1.1  ",
+		120000,
+		retry,
+		AT_CATCH_ERROR | AT_CAPTURE_REPLY,
+		0,									// keep the status given by the handler
+		httpReplyHandler,
+		EVENT_NONE
+	};
+	
+	return queueAT(command);
+}
+
+
+/**** Socket ****/
+
+// The A9 has a single socket, either TCP or UDP. The data is written on it
+// with AT+CIPSEND, what the server sends back arrives as +CIPRCV lines that
+// are parsed with the unsolicited result codes.
+
+// length of the command once each '%' is replaced by its argument
+static size_t commandLength(const ATCommand* command)
+{
+	const char* format = command->format;
+	uint8_t arg = 0;
+	size_t length = 0;
+	
+	while (*format != '\0')
+	{
+		if (*format == '%' && arg < AT_MAX_ARGS)
+			length += strlen(command->args[arg++]);
+		else
+			length++;
+		
+		format++;
+	}
+	
+	return length;
+}
+
+
+// queue AT+CIPSEND followed by the data it announces. The length is kept
+// in the object, so no other data can be queued till poll() is done
+void GPRS::queueSocketData(const ATCommand& data)
+{
+	// SUCCESS		>  then  OK
+	//
+	// ERROR		+CME ERROR: 3
+	//				socket not connected
+	
+	ATCommand prompt =
+	{
+		"AT+CIPSEND=%",
+		{ socketSendLength },
+		">",
+		5000,
+		1,
+		AT_CATCH_ERROR,
+		data.failCode,
+		NULL,
+		EVENT_NONE
+	};
+	
+	utoa(commandLength(&data), socketSendLength, 10);
+	
+	queueAT(prompt);
+	queueAT(data);
+}
+
+
+bool GPRS::beginSocketClose()
+{
+	// SUCCESS		OK
+	//
+	// ERROR		+CME ERROR: 3
+	//				socket already closed
+	
+	ATCommand command =
+	{
+		"AT+CIPCLOSE",
+		{ NULL },
+		"OK\r\n",
+		5000,
+		2,
+		AT_CATCH_ERROR | AT_OPTIONAL,
+		0,
+		NULL,
+		EVENT_NONE
+	};
+	
+	modemState.socketOpen = false;	// the socket is given up either way
+	
+	return queueAT(command);
+}
+
+
+/**** TCP ****/
+
+// A single connection is kept open and the requests are written on it, so
+// the connection and the DNS lookup are done once instead of at every
+// AT+HTTPPOST. A request is done as soon as the modem took it, its response
+// is read later with getTCPResponse, so the next one can be sent before
+// (pipelining). The responses come back in the order of the requests.
+// There is no TLS on the raw socket, the server must accept plain HTTP.
+
+bool GPRS::beginTCPConnect(const char* host, const char* port)
+{
+	// SUCCESS		CONNECT OK
+	//
+	// ERROR		+CME ERROR: 53					CONNECT FAIL
+	//				Dns fail						(timeout)
+	
+	ATCommand command =
+	{
+		"AT+CIPSTART=\"TCP\",\"%\",%",
+		{ host, port },
+		"CONNECT OK",
+		30000,
+		3,
+		AT_CATCH_ERROR,
+		TCP_CONNECT_FAIL,
+		NULL,
+		EVENT_NONE
+	};
+	
+	tcpResponses.clear();		// responses of the previous socket are lost
+	modemState.socketUDP = false;
+	
+	return queueAT(command);
+}
+
+
+// the strings must stay unchanged till poll() stops returning GPRS_BUSY
+bool GPRS::beginTCPPOST(const char* host, const char* path, const char* contentType, const char* postData)
+{	
+	static const char request[] =
+		"POST % HTTP/1.1\r\n"
+		"Host: %\r\n"
+		"Content-Type: %\r\n"
+		"Content-Length: %\r\n"
+		"Connection: keep-alive\r\n"
+		"\r\n"
+		"%";
+	
+	if (isBusy() || isTCPConnected() == false)
+		return false;
+	
+	ATCommand data =
+	{
+		request,
+		{ path, host, contentType, tcpContentLength, postData },
+		"\r\nOK\r\n",						// the status line of a response ends with " OK\r\n"
+		20000,
+		1,									// the prompt is gone, the data can't be sent again
+		AT_CATCH_ERROR | AT_RAW,
+		TCP_SEND_FAIL,
+		NULL,
+		EVENT_NONE
+	};
+	
+	utoa(strlen(postData), tcpContentLength, 10);
+	queueSocketData(data);
+	
+	return true;
+}
+
+
+bool GPRS::isTCPConnected()
+{
+	return modemState.socketOpen && modemState.socketUDP == false;
+}
+
+
+// status of the oldest response not read yet, false if none was received
+bool GPRS::getTCPResponse(uint8_t* status)
+{
+	return tcpResponses.pop(status);
+}
+
+
+/**** UDP ****/
+
+// Each datagram is sent once by the modem, the server acknowledges the
+// sequence numbers it received and the lost ones are sent again by the
+// caller (see UDPWindow.h).
+
+bool GPRS::beginUDPOpen(const char* host, const char* port)
+{
+	// SUCCESS		CONNECT OK
+	//
+	// ERROR		+CME ERROR: 53
+	//				Dns fail
+	
+	ATCommand command =
+	{
+		"AT+CIPSTART=\"UDP\",\"%\",%",
+		{ host, port },
+		"CONNECT OK",
+		30000,
+		3,
+		AT_CATCH_ERROR,
+		UDP_OPEN_FAIL,
+		NULL,
+		EVENT_NONE
+	};
+	
+	udpAckReceived = false;
+	modemState.socketUDP = true;
+	
+	return queueAT(command);
+}
+
+
+// the datagram must stay unchanged till poll() stops returning GPRS_BUSY
+bool GPRS::beginUDPSend(const char* datagram)
+{
+	if (isBusy() || isUDPOpen() == false)
+		return false;
+	
+	ATCommand data =
+	{
+		"%",
+		{ datagram },
+		"\r\nOK\r\n",
+		10000,
+		1,									// the prompt is gone, the data can't be sent again
+		AT_CATCH_ERROR | AT_RAW,
+		UDP_SEND_FAIL,
+		NULL,
+		EVENT_NONE
+	};
+	
+	queueSocketData(data);
+	
+	return true;
+}
+
+
+bool GPRS::isUDPOpen()
+{
+	return modemState.socketOpen && modemState.socketUDP;
+}
+
+
+// last acknowledgment received, false if none came since the last call
+bool GPRS::getUDPAck(uint16_t* seq, uint32_t* bitmap)
+{
+	if (udpAckReceived == false)
+		return false;
+	
+	*seq = udpAckSeq;
+	*bitmap = udpAckBitmap;
+	udpAckReceived = false;
+	return true;
+}
+
+
+/**** GSM ****/
+
+uint8_t GPRS::waitGSMReg()
+{
+	// SUCCESS		+CREG: stat					(unsolicited result)
+	//				+CREG: n,stat				(reply to AT+CREG?)
+	//				n= 0: disable unsolicited result code. 1: enable unsolicited result code.
+	//				   2: enable location information
+	//				stat= 0: not registered and not searching. 1: registered home network.
+	//					  2: not registered and currently searching. 3: registration denied
+	//					  4: unknown. 5: registered roaming
+	//
+	// ERROR		NONE
+	//
+
+	sendAT("AT+CREG=1", "OK\r\n", 1000, 2);		// enable network registration unsolicited result
+	sendAT("AT+CREG?", "OK\r\n", 1000, 2);		// the reply refreshes the registration state
+	
+	// registration completes as soon as the network reports it
+	if (waitEvent(EVENT_GSM_REGISTERED, REGISTRATION_TIMEOUT) != GPRS_SUCCESS_REPLY)
+		return GSM_REGISTERATION_FAIL;
+	
+	return GPRS_SUCCESS_REPLY;
+}
+
+
+uint8_t GPRS::setSMSTextFormat()
+{
+	// SUCCESS		OK
+	//
+	// ERROR		NONE
+	//
+	
+	return sendAT("AT+CMGF=1", "OK\r\n", 2000, 2);
+}
+
+
+uint8_t GPRS::sendSMS(const char* phone_number, const char* message)
+{
+	// SUCCESS		+CMGS: 1						+CMGS: 2				+CMGS: 3
+	//				phone number isn't allowed		successful sending		
+	//
+	// ERROR		+CMS ERROR						COMMAND NO RESPONSE
+	//				failing to send message			if 0x1A is ignored
+	
+	uint8_t status;
+	
+	status = prepareCommand();
+	
+	if (status != GPRS_SUCCESS_REPLY)
+		return status;
+
+	serialGPRS.sendString("AT+CMGS=");
+	serialGPRS.send('\"');
+	serialGPRS.sendString(phone_number);
+	serialGPRS.sendString("\"\r\n");
+	
+	waitResponse(">", 1000);
+	_delay_ms(50);
+	
+	serialGPRS.sendString(message);
+	serialGPRS.send(0x1A);
+	
+	status = waitOneOf("+CMS ERROR", "+CMGS:", 45000);
+	
+	if(status != 2)
+		status = SMS_SENDING_ERROR;
+	else
+		status = GPRS_SUCCESS_REPLY;
+	
+	_delay_ms(100);
+	return status;
+}
+
+
+// same exchange as sendSMS, run by poll(). The number and the message are
+// kept by the caller till the end of the job
+bool GPRS::beginSMS(const char* phone_number, const char* message)
+{
+	// SUCCESS		>  then  +CMGS: 2
+	//
+	// ERROR		+CMS ERROR, caught, ends the job right away with SMS_SENDING_ERROR
+	
+	static const ATCommand sequence[] PROGMEM =
+	{
+		// format				args				exptReply	timeout	retry	flags						failCode			handler	event
+		{ "AT+CMGS=\"%\"",		{ NULL },		">",		1000,	1,		AT_CATCH_ERROR,				SMS_SENDING_ERROR,	NULL,	EVENT_NONE },
+		{ "%\x1A",				{ NULL },		"+CMGS:",	45000,	1,		AT_CATCH_ERROR | AT_RAW,	SMS_SENDING_ERROR,	NULL,	EVENT_NONE }
+	};
+	
+	if (isBusy())
+		return false;
+	
+	queueAT_P(&sequence[0])->args[0] = phone_number;
+	queueAT_P(&sequence[1])->args[0] = message;
+	
+	return true;
+}
+
+
+/**** Balance ****/
+
+uint8_t GPRS::checkBalance(const char* code)
+{
+	// iam code #580#
+	// orange code #554#
+		
+	// SUCCESS		OK
+	//
+	// ERROR		+CME ERROR: 15790320 			+CUSD: 2
+	//												session closed
+	
+	uint8_t status;
+	
+	status = prepareCommand();
+	
+	if (status != GPRS_SUCCESS_REPLY)
+		return status;
+
+	serialGPRS.sendString("AT+CUSD=1,\"");
+	serialGPRS.sendString(code);
+	serialGPRS.sendString("\",15\r\n");
+	
+	status = waitOneOf("+CUSD: 1", "+CUSD: 2", 6000);
+	
+	if(status != 1)
+		status = CHECK_BALANCE_ERROR;
+	else
+		status = GPRS_SUCCESS_REPLY;
+	
+	_delay_ms(500);
+	return status;
+}
+
+
+/**** Location ****/
+
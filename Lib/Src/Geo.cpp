@@ -0,0 +1,122 @@
+/*
+ * Geo.cpp
+ *
+ * Integer helpers for the small distances between two fixes
+ *
+ * Author: Karim Bouanane
+ * Hardware : ATMEGA328P
+ */
+
+#include <stdlib.h>
+#include <avr/pgmspace.h>
+#include "Geo.h"
+
+#define COS_STEP	50000000L		// 5 deg between two entries of the table
+#define HALF_TURN	1800000000L		// 180 deg, a full turn in half units
+
+
+// cos of 0, 5, 10 ... 90 deg, scaled by GEO_COS_ONE
+static const uint8_t cosTable[] PROGMEM =
+{
+	255, 254, 251, 246, 240, 231, 221, 209, 195, 180,
+	164, 146, 128, 108,  87,  66,  44,  22,   0
+};
+
+
+// cos of a latitude (1e-7 deg), linear between two entries of the table
+// cost : 1 mul32, 2 div32
+uint8_t geoCos(long latitude)
+{
+	uint32_t angle = labs(latitude);
+	uint8_t index;
+	uint8_t low;
+	uint8_t high;
+
+	if (angle >= 900000000UL)
+		return 0;
+
+	index = angle / COS_STEP;
+	low = pgm_read_byte(&cosTable[index]);
+	high = pgm_read_byte(&cosTable[index + 1]);
+
+	return low - (uint8_t)((uint32_t)(low - high) * (angle % COS_STEP) / COS_STEP);
+}
+
+
+static long clampOffset(long meters)
+{
+	if (meters > GEO_MAX_OFFSET)
+		return GEO_MAX_OFFSET;
+
+	if (meters < -GEO_MAX_OFFSET)
+		return -GEO_MAX_OFFSET;
+
+	return meters;
+}
+
+
+// offset in m of the second point from the first one
+void geoOffset(long fromLat, long fromLng, long toLat, long toLng, long* east, long* north)
+{
+	int32_t dLat = toLat - fromLat;
+
+	// half units, so the difference fits even across the antimeridian
+	int32_t dLng = toLng / 2 - fromLng / 2;
+
+	if (dLng > HALF_TURN / 2)
+		dLng -= HALF_TURN;
+	else if (dLng < -HALF_TURN / 2)
+		dLng += HALF_TURN;
+
+	*north = clampOffset(dLat / GEO_UNITS_PER_METER);
+	*east = clampOffset(dLng / (GEO_UNITS_PER_METER / 2)) * geoCos(fromLat) / GEO_COS_ONE;
+}
+
+
+// distance in m between two points
+uint32_t geoDistance(long fromLat, long fromLng, long toLat, long toLng)
+{
+	long east;
+	long north;
+	uint32_t a;
+	uint32_t b;
+
+	geoOffset(fromLat, fromLng, toLat, toLng, &east, &north);
+
+	a = labs(east);
+	b = labs(north);
+
+	// the squares would overflow, max + 3/8 min is within 7 %
+	if (a > 46000 || b > 46000)
+		return a > b ? a + 3 * b / 8 : b + 3 * a / 8;
+
+	return isqrt32(a * a + b * b);
+}
+
+
+// floor of the square root, bit by bit
+uint16_t isqrt32(uint32_t value)
+{
+	uint32_t root = 0;
+	uint32_t bit = 1UL << 30;
+
+	while (bit > value)
+		bit >>= 2;
+
+	while (bit != 0)
+	{
+		if (value >= root + bit)
+		{
+			value -= root + bit;
+			root = (root >> 1) + bit;
+		}
+		else
+		{
+			root >>= 1;
+		}
+
+		bit >>= 2;
+	}
+
+	return root;
+}
@@ -0,0 +1,141 @@
+/*
+ * Geofence.cpp
+ *
+ * Zones checked on the tracker itself, polygons and circles kept in the flash
+ *
+ * Author: Karim Bouanane
+ * Hardware : ATMEGA328P
+ */
+
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include "Geofence.h"
+#include "Geo.h"
+
+
+Geofence::Geofence(const GeoZone* table, uint8_t count)
+	: zones(table)
+	, zoneCount(count > GEOFENCE_MAX_ZONES ? GEOFENCE_MAX_ZONES : count)
+	, inside(0)
+	, candidate(0)
+	, started(false)
+{
+}
+
+
+/**** Containment ****/
+
+// crossing number of a ray going east from the point, the polygon is closed
+// from its last vertex back to the first one
+bool Geofence::polygonContains(const GeoZone* zone, long latitude, long longitude)
+{
+	GeoPoint a;
+	GeoPoint b;
+	int64_t cross;
+	bool in = false;
+
+	memcpy_P(&a, &zone->vertices[zone->vertexCount - 1], sizeof(GeoPoint));
+
+	for (uint8_t i = 0; i < zone->vertexCount; i++, a = b)
+	{
+		memcpy_P(&b, &zone->vertices[i], sizeof(GeoPoint));
+
+		if ((a.latitude > latitude) == (b.latitude > latitude))
+			continue;
+
+		// the point is west of the edge when the cross product has the sign of its direction
+		cross = (int64_t)(b.longitude - a.longitude) * (latitude - a.latitude) -
+				(int64_t)(longitude - a.longitude) * (b.latitude - a.latitude);
+
+		if ((cross > 0) == (b.latitude > a.latitude))
+			in = !in;
+	}
+
+	return in;
+}
+
+
+bool Geofence::contains(const GeoZone* zone, long latitude, long longitude)
+{
+	if (latitude < zone->box.minLat || latitude > zone->box.maxLat ||
+		longitude < zone->box.minLng || longitude > zone->box.maxLng)
+		return false;
+
+	if (zone->vertices == NULL)
+		return geoDistance(zone->center.latitude, zone->center.longitude, latitude, longitude) <= zone->radius;
+
+	return polygonContains(zone, latitude, longitude);
+}
+
+
+/**** Zones ****/
+
+// give a new fix, return the mask of the zones entered or left. The first
+// fix sets the zones the vehicle starts in, without any transition
+uint8_t Geofence::update(long latitude, long longitude)
+{
+	GeoZone zone;
+	uint8_t now = 0;
+	uint8_t changed;
+	uint8_t confirmed;
+
+	for (uint8_t i = 0; i < zoneCount; i++)
+	{
+		memcpy_P(&zone, &zones[i], sizeof(GeoZone));
+
+		if (contains(&zone, latitude, longitude))
+			now |= _BV(i);
+	}
+
+	if (started == false)
+	{
+		inside = now;
+		candidate = 0;
+		started = true;
+		return 0;
+	}
+
+	// a change seen on two fixes in a row, a single fix on the border is ignored
+	changed = now ^ inside;
+	confirmed = changed & candidate;
+	candidate = changed;
+	inside ^= confirmed;
+	candidate &= ~confirmed;
+
+	return confirmed;
+}
+
+
+bool Geofence::isInside(uint8_t zone)
+{
+	return inside & _BV(zone);
+}
+
+
+// mask of the zones the vehicle is in, bit i for the zone i
+uint8_t Geofence::getInside()
+{
+	return inside;
+}
+
+
+uint8_t Geofence::getZoneCount()
+{
+	return zoneCount;
+}
+
+
+void Geofence::getName(uint8_t zone, char* buff, size_t len)
+{
+	const char* name = (const char*)pgm_read_ptr(&zones[zone].name);
+
+	strncpy_P(buff, name, len - 1);
+	buff[len - 1] = '\0';
+}
+
+
+// the next fix sets the zones again, without any transition
+void Geofence::reset()
+{
+	started = false;
+}
@@ -0,0 +1,448 @@
+/*
+ * KalmanFilter.cpp
+ *
+ * Constant velocity Kalman filter smoothing the GPS position
+ *
+ * Author: Karim Bouanane
+ * Hardware : ATMEGA328P
+ */
+
+#include <stdlib.h>
+#include "KalmanFilter.h"
+#include "Geo.h"
+
+#define MM_PER_UNIT_X100	1113			// 1e-7 deg of latitude is 11.13 mm
+#define HALF_TURN			1800000000L		// 180 deg, a full turn in half units
+#define MAX_VARIANCE		400000000L		// cm2, (200 m)2
+#define MAX_SPEED			100000L			// mm/s
+#define START_SPEED_VAR		1000000L		// cm2/s2, (10 m/s)2 when the speed is unknown
+
+
+/**** Axis ****/
+
+// The AVR has no divider, a 32 bit division is much slower than a product
+// and a 64 bit one slower still. The filter uses 32 bit arithmetic only,
+// the gains are Q16 and the covariances follow from products by the gains.
+// The cost of each part, in calls of the libgcc routines, is noted above it
+// and read by tools/kalmansim.cpp, keep it up to date
+
+// terms of the prediction shared by both axes
+typedef struct
+{
+	uint32_t t;				// s		Q16, 10 s at most
+	uint32_t t2;			// s2		Q16
+	long q1;				// cm2/s2	q t
+	long q2;				// cm2/s	q t2 / 2
+	long q3;				// cm2		q t3 / 3
+
+} KalmanStep;
+
+
+// (k * p) >> 16 from 32 bit products, the result must fit in 32 bits
+// cost : 3 mul32
+static uint32_t mulQ16u(uint32_t k, uint32_t p)
+{
+	return (k >> 16) * p + (k & 0xFFFF) * (p >> 16) + ((k & 0xFFFF) * (p & 0xFFFF) >> 16);
+}
+
+
+static long mulQ16(long k, long p)
+{
+	long result = mulQ16u(labs(k), labs(p));
+
+	return (k < 0) != (p < 0) ? -result : result;
+}
+
+
+// p / s in Q16 from a 32 bit division, s > 0. Both are shifted till s fits
+// in 12 bits, the gain keeps 11 significant bits at least
+// cost : 1 div32
+static long gainQ16(long p, long s)
+{
+	uint32_t numerator = labs(p);
+	long gain;
+
+	while (s > 0x0FFF)
+	{
+		s >>= 1;
+		numerator >>= 1;
+	}
+
+	if (numerator > 0xFFFF)
+		numerator = 0xFFFF;			// no gain is that large, the shift below fits in 32 bits
+
+	gain = (numerator << 16) / (uint32_t)s;
+
+	return p < 0 ? -gain : gain;
+}
+
+
+static long clampVariance(long value)
+{
+	if (value > MAX_VARIANCE)
+		return MAX_VARIANCE;
+
+	if (value < -MAX_VARIANCE)
+		return -MAX_VARIANCE;
+
+	return value;
+}
+
+
+// a variance rounded below zero
+static long keepPositive(long value)
+{
+	return value < 1 ? 1 : value;
+}
+
+
+// variance p times a time t (s, Q16, 10 s at most), saturated. With
+// |p| <= MAX_VARIANCE the product fits in 32 bits unsigned
+// cost : 3 mul32
+static long scaleVariance(long p, uint32_t t)
+{
+	uint32_t result = mulQ16u(t, labs(p));
+
+	if (result > MAX_VARIANCE)
+		result = MAX_VARIANCE;
+
+	return p < 0 ? -(long)result : (long)result;
+}
+
+
+// square of an accuracy estimate in mm, in cm2
+// cost : 1 mul32, 1 div32
+static long accuracyVariance(uint32_t accuracy)
+{
+	long cm = accuracy / 10;
+
+	if (cm > KALMAN_MAX_ACCURACY)
+		cm = KALMAN_MAX_ACCURACY;
+
+	return cm == 0 ? 1 : cm * cm;
+}
+
+
+static void startAxis(KalmanAxis* axis, long velocity, long r, long rv)
+{
+	axis->x = 0;
+	axis->v = velocity;
+	axis->p00 = r;
+	axis->p01 = 0;
+	axis->p11 = rv;
+}
+
+
+// the terms of a step of dt ms, the acceleration is white noise of density q
+// cost : 16 mul32, 1 div32
+static void startStep(KalmanStep* step, uint32_t dt, uint16_t q)
+{
+	step->t = dt * 8389UL >> 7;			// 65536 / 1000 = 8389 / 128 within 0.005 %
+	step->t2 = mulQ16u(step->t, step->t);
+	step->q1 = mulQ16(q, step->t);
+	step->q2 = mulQ16(q, step->t2) / 2;
+	step->q3 = mulQ16(q, mulQ16u(step->t2, step->t)) / 3;
+}
+
+
+// move the state one step forward
+// cost : 12 mul32
+static void predictAxis(KalmanAxis* axis, const KalmanStep* step)
+{
+	long p11t = scaleVariance(axis->p11, step->t);
+
+	axis->x += mulQ16(step->t, axis->v);
+
+	axis->p00 = clampVariance(axis->p00 + 2 * scaleVariance(axis->p01, step->t) + scaleVariance(p11t, step->t) + step->q3);
+	axis->p01 = clampVariance(axis->p01 + p11t + step->q2);
+	axis->p11 = clampVariance(axis->p11 + step->q1);
+}
+
+
+// true if the position z (mm) is farther than KALMAN_GATE sigmas from the prediction
+// cost : 1 mul32, 1 isqrt32
+static bool isOutlier(const KalmanAxis* axis, long z, long r)
+{
+	return labs(z - axis->x) > (long)KALMAN_GATE * 10 * isqrt32(axis->p00 + r);
+}
+
+
+// measure the position z (mm) with a variance r (cm2)
+// cost : 15 mul32, 2 div32
+static void updatePosition(KalmanAxis* axis, long z, long r)
+{
+	long s = axis->p00 + r;
+	long k0 = gainQ16(axis->p00, s);		// Q16
+	long k1 = gainQ16(axis->p01, s);		// Q16 1/s
+	long y = z - axis->x;
+
+	axis->x += mulQ16(k0, y);
+	axis->v += mulQ16(k1, y);
+
+	axis->p11 = keepPositive(axis->p11 - mulQ16(k1, axis->p01));
+	axis->p01 -= mulQ16(k0, axis->p01);
+	axis->p00 = keepPositive(axis->p00 - mulQ16(k0, axis->p00));
+}
+
+
+// measure the velocity z (mm/s) with a variance r (cm2/s2)
+// cost : 15 mul32, 2 div32
+static void updateVelocity(KalmanAxis* axis, long z, long r)
+{
+	long s = axis->p11 + r;
+	long k0 = gainQ16(axis->p01, s);		// Q16 s
+	long k1 = gainQ16(axis->p11, s);		// Q16
+	long y = z - axis->v;
+
+	axis->x += mulQ16(k0, y);
+	axis->v += mulQ16(k1, y);
+
+	axis->p00 = keepPositive(axis->p00 - mulQ16(k0, axis->p01));
+	axis->p01 -= mulQ16(k1, axis->p01);
+	axis->p11 = keepPositive(axis->p11 - mulQ16(k1, axis->p11));
+}
+
+
+static long clampSpeed(long value)
+{
+	if (value > MAX_SPEED)
+		return MAX_SPEED;
+
+	if (value < -MAX_SPEED)
+		return -MAX_SPEED;
+
+	return value;
+}
+
+
+// longitude difference in half units, across the antimeridian too
+static long halfDelta(long to, long from)
+{
+	long delta = to / 2 - from / 2;
+
+	if (delta > HALF_TURN / 2)
+		delta -= HALF_TURN;
+	else if (delta < -HALF_TURN / 2)
+		delta += HALF_TURN;
+
+	return delta;
+}
+
+
+/**** Filter ****/
+
+KalmanFilter::KalmanFilter(uint16_t q)
+	: originLat(0)
+	, originLng(0)
+	, originCos(GEO_COS_ONE)
+	, lastTOW(0)
+	, started(false)
+	, outliers(0)
+	, noise(q)
+	, outlierCount(0)
+{
+}
+
+
+// acceleration noise density in cm2/s3, larger follows the turns faster but smooths less
+void KalmanFilter::setNoise(uint16_t q)
+{
+	noise = q;
+}
+
+
+// mm from the origin
+// cost : 1 mul32, 1 div32
+long KalmanFilter::toNorth(long latitude)
+{
+	return (latitude - originLat) * MM_PER_UNIT_X100 / 100;
+}
+
+
+// cost : 2 mul32, 2 div32
+long KalmanFilter::toEast(long longitude)
+{
+	long equator = halfDelta(longitude, originLng) * (2 * MM_PER_UNIT_X100) / 100;	// mm at the equator
+
+	return equator * originCos / GEO_COS_ONE;
+}
+
+
+// the filter starts again on this fix
+void KalmanFilter::start(const NavSolution* nav)
+{
+	long r = accuracyVariance(nav->hAcc);
+	long rv = nav->sAcc != 0 ? accuracyVariance(nav->sAcc) : START_SPEED_VAR;
+
+	originLat = nav->latitude;
+	originLng = nav->longitude;
+	originCos = geoCos(originLat);
+
+	if (originCos == 0)
+		originCos = 1;
+
+	startAxis(&north, clampSpeed(nav->velN), r, rv);
+	startAxis(&east, clampSpeed(nav->velE), r, rv);
+
+	lastTOW = nav->iTOW;
+	outliers = 0;
+	started = true;
+}
+
+
+// the origin goes to the estimate, so the offsets stay small
+void KalmanFilter::moveOrigin()
+{
+	long latitude = getLatitude();
+	long longitude = getLongitude();
+
+	north.x -= toNorth(latitude);
+	east.x -= toEast(longitude);
+
+	originLat = latitude;
+	originLng = longitude;
+	originCos = geoCos(originLat);
+
+	if (originCos == 0)
+		originCos = 1;
+}
+
+
+// give a new fix, return false if it is ignored as an outlier
+bool KalmanFilter::update(const NavSolution* nav)
+{
+	uint32_t dt = nav->iTOW - lastTOW;
+	long r = accuracyVariance(nav->hAcc);
+	long zNorth = 0;
+	long zEast = 0;
+	KalmanStep step;
+
+	if (started == false || dt > KALMAN_MAX_GAP)
+	{
+		start(nav);
+		return true;
+	}
+
+	lastTOW = nav->iTOW;
+
+	startStep(&step, dt, noise);
+	predictAxis(&north, &step);
+	predictAxis(&east, &step);
+
+	if (labs(nav->latitude - originLat) > KALMAN_ORIGIN_RANGE ||
+		labs(halfDelta(nav->longitude, originLng)) > KALMAN_ORIGIN_RANGE / 2)
+		moveOrigin();
+
+	// too far to be measured in the local frame, or farther than the gate
+	bool outlier = labs(nav->latitude - originLat) > 2 * KALMAN_ORIGIN_RANGE ||
+				   labs(halfDelta(nav->longitude, originLng)) > KALMAN_ORIGIN_RANGE;
+
+	if (outlier == false)
+	{
+		zNorth = toNorth(nav->latitude);
+		zEast = toEast(nav->longitude);
+		outlier = isOutlier(&north, zNorth, r) || isOutlier(&east, zEast, r);
+	}
+
+	if (outlier)
+	{
+		outlierCount++;
+
+		if (++outliers >= KALMAN_MAX_OUTLIERS)
+		{
+			start(nav);
+			return true;
+		}
+
+		return false;
+	}
+
+	outliers = 0;
+
+	updatePosition(&north, zNorth, r);
+	updatePosition(&east, zEast, r);
+
+	// sAcc is only given by NAV_PVT
+	if (nav->sAcc != 0)
+	{
+		r = accuracyVariance(nav->sAcc);
+		updateVelocity(&north, clampSpeed(nav->velN), r);
+		updateVelocity(&east, clampSpeed(nav->velE), r);
+	}
+
+	north.v = clampSpeed(north.v);
+	east.v = clampSpeed(east.v);
+
+	return true;
+}
+
+
+// the next fix starts the filter again
+void KalmanFilter::reset()
+{
+	started = false;
+}
+
+
+/**** Estimate ****/
+
+// deg (1e-7)
+// cost : 1 mul32, 1 div32
+long KalmanFilter::getLatitude()
+{
+	return originLat + north.x * 100 / MM_PER_UNIT_X100;
+}
+
+
+// cost : 2 mul32, 2 div32
+long KalmanFilter::getLongitude()
+{
+	long equator = east.x * GEO_COS_ONE / originCos;				// mm at the equator
+	long half = equator * 50 / MM_PER_UNIT_X100;					// 100 / (2 * 11.13) half units per mm
+	long longitude = originLng / 2 + half;
+
+	if (longitude > HALF_TURN / 2)
+		longitude -= HALF_TURN;
+	else if (longitude < -HALF_TURN / 2)
+		longitude += HALF_TURN;
+
+	return longitude * 2 + originLng % 2;
+}
+
+
+// mm/s
+long KalmanFilter::getVelocityNorth()
+{
+	return north.v;
+}
+
+
+long KalmanFilter::getVelocityEast()
+{
+	return east.v;
+}
+
+
+long KalmanFilter::getSpeed()
+{
+	long vn = north.v / 10;
+	long ve = east.v / 10;
+
+	return (long)isqrt32(vn * vn + ve * ve) * 10;
+}
+
+
+// mm, horizontal standard deviation of the estimate
+uint32_t KalmanFilter::getAccuracy()
+{
+	return (uint32_t)isqrt32(north.p00 + east.p00) * 10;
+}
+
+
+/**** Statistics ****/
+
+// fixes ignored since the start
+uint16_t KalmanFilter::getOutlierCount()
+{
+	return outlierCount;
+}
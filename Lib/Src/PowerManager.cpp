@@ -0,0 +1,178 @@
+/*
+ * PowerManager.cpp
+ *
+ * Sleep between the reports, the MCU in power-down woken up by the watchdog
+ *
+ * Author: Karim Bouanane
+ * Hardware : ATMEGA328P
+ */
+
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <avr/pgmspace.h>
+#include "PowerManager.h"
+#include "Power.h"
+#include "Sleep.h"
+#include "Timer.h"
+
+
+// watchdog prescaler of each period, 16 ms << index
+static const uint8_t wdtPeriods[WDT_PERIODS] PROGMEM =
+{
+	SLEEP_15MS, SLEEP_30MS, SLEEP_60MS, SLEEP_120MS, SLEEP_250MS,
+	SLEEP_500MS, SLEEP_1S, SLEEP_2S, SLEEP_4S, SLEEP_8S
+};
+
+
+PowerManager::PowerManager(GPRS* gprs, Ublox* gps)
+	: modem(gprs)
+	, gnss(gps)
+	, calibrationTime(0)
+	, calibrated(false)
+	, sleptTime(0)
+	, sleepCount(0)
+{
+}
+
+
+// the analog blocks draw current even in power-down, they are never used
+void PowerManager::begin()
+{
+	disable_adc();
+	power_adc_off();
+	power_ac_off();
+	power_spi_off();
+	power_twi_off();
+	power_timer2_off();
+}
+
+
+/**** Watchdog Calibration ****/
+
+// the watchdog oscillator is only within 10 % of 128 kHz, a 1024 ms period
+// is measured against Timer1, in idle mode so Timer1 keeps counting
+void PowerManager::calibrate()
+{
+	uint32_t start = timerNow();
+
+	wdtWakeup = false;
+	wakeupAfter(SLEEP_1S);
+
+	while (wdtWakeup == false)
+		goTosleep(mode_idle);
+
+	chain.setCalibration(timerNow() - start);
+	calibrationTime = timerNow();
+	calibrated = true;
+
+	wdt_off();
+}
+
+
+uint16_t PowerManager::getWDTCalibration()
+{
+	return chain.getCalibration();
+}
+
+
+/**** Sleep ****/
+
+// one watchdog period in power-down, the other interrupts send the MCU back to sleep
+void PowerManager::sleepPeriod(uint8_t index)
+{
+	wdtWakeup = false;
+	wakeupAfter(pgm_read_byte(&wdtPeriods[index]));
+
+	// wdtWakeup is tested with the interrupts off, a watchdog interrupt coming
+	// after the test still wakes up the MCU : sei() lets sleep_cpu() run first
+	set_sleep_mode(mode_pwr_down);
+	cli();
+
+	while (wdtWakeup == false)
+	{
+		sleep_enable();
+		sleep_bod_disable();
+		sei();
+		sleep_cpu();
+		sleep_disable();
+		cli();
+	}
+
+	sei();
+}
+
+
+// sleep about ms, return the time slept in power-down
+uint32_t PowerManager::sleep(uint32_t ms)
+{
+	return sleepUntil(timerNow() + ms);
+}
+
+
+// sleep till timerNow() reaches the deadline, return the time slept in
+// power-down. The calibrated watchdog periods are chained while they fit,
+// the rest, below 16 ms, is waited for on Timer1. Its overflow wakes the
+// idle mode every 262 ms only, so the last ms are counted awake
+uint32_t PowerManager::sleepUntil(uint32_t deadline)
+{
+	uint32_t slept = 0;			// ms
+	int32_t left = deadline - timerNow();
+	uint16_t ms;
+	uint8_t index;
+
+	if (left >= POWER_MIN_SLEEP + POWER_CALIBRATION_TIME &&
+		(calibrated == false || timerNow() - calibrationTime >= POWER_CALIBRATION_INTERVAL))
+	{
+		calibrate();
+		left = deadline - timerNow();
+	}
+
+	if (left >= POWER_MIN_SLEEP)
+	{
+		if (modem != NULL && modem->isAsleep() == false)
+			modem->sleep(GPRS_SLEEP_MODE);
+
+		if (gnss != NULL)
+			gnss->sleep();
+
+		left = deadline - timerNow();
+
+		// the longest period left each time
+		while ((index = chain.next(left)) != WDT_CHAIN_DONE)
+		{
+			sleepPeriod(index);
+
+			ms = chain.credit(index);
+			slept += ms;
+			left -= ms;
+		}
+
+		wdt_off();
+		timerAdvance(slept);
+
+		if (gnss != NULL)
+			gnss->wakeup();
+
+		sleptTime += slept;
+		sleepCount++;
+	}
+
+	while ((int32_t)(deadline - timerNow()) > 0)
+		;
+
+	return slept;
+}
+
+
+/**** Statistics ****/
+
+uint32_t PowerManager::getSleptTime()
+{
+	return sleptTime;
+}
+
+
+uint16_t PowerManager::getSleepCount()
+{
+	return sleepCount;
+}
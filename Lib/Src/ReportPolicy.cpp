@@ -0,0 +1,130 @@
+/*
+ * ReportPolicy.cpp
+ *
+ * Decide which fixes are worth sending, from the distance, the heading and
+ * the speed given by the GPS
+ *
+ * Author: Karim Bouanane
+ * Hardware : ATMEGA328P
+ */
+
+#include <stdlib.h>
+#include "ReportPolicy.h"
+#include "Geo.h"
+
+#define HEADING_SCALE		100000L			// headMot unit is 1e-5 deg
+#define FULL_TURN			(360L * HEADING_SCALE)
+
+
+// defaults suited to a car in town
+static const ReportThresholds defaultThresholds =
+{
+	100,		// distance			m
+	30,			// heading			deg
+	1500,		// movingSpeed		mm/s	(5.4 km/h)
+	5000,		// minInterval		ms
+	120000,		// maxInterval		ms
+	1800000		// heartbeat		ms		(30 min)
+};
+
+
+ReportPolicy::ReportPolicy()
+	: thresholds(defaultThresholds)
+	, reported(false)
+	, lastLatitude(0)
+	, lastLongitude(0)
+	, lastHeading(0)
+	, lastTime(0)
+	, skippedCount(0)
+{
+}
+
+
+/**** Settings ****/
+
+void ReportPolicy::setThresholds(const ReportThresholds& value)
+{
+	thresholds = value;
+}
+
+
+const ReportThresholds* ReportPolicy::getThresholds()
+{
+	return &thresholds;
+}
+
+
+/**** Decision ****/
+
+// the heading is only meaningful above the moving speed, the speed is 0
+// when the fix comes from NAV_POSLLH and NAV_STATUS
+bool ReportPolicy::isMoving(const NavSolution* nav)
+{
+	return nav->gSpeed >= (long)thresholds.movingSpeed;
+}
+
+
+// return true if the fix must be reported, it becomes the reference of the next decisions
+bool ReportPolicy::shouldReport(const NavSolution* nav, uint32_t now)
+{
+	uint32_t elapsed = now - lastTime;
+	bool moving = isMoving(nav);
+	bool report;
+	long turn;
+
+	if (reported == false)
+	{
+		report = true;
+	}
+	else if (elapsed < thresholds.minInterval)
+	{
+		report = false;
+	}
+	else if (geoDistance(lastLatitude, lastLongitude, nav->latitude, nav->longitude) >= thresholds.distance)
+	{
+		report = true;
+	}
+	else if (moving)
+	{
+		turn = labs(nav->headMot - lastHeading) % FULL_TURN;
+
+		if (turn > FULL_TURN / 2)
+			turn = FULL_TURN - turn;
+
+		report = turn >= (long)thresholds.heading * HEADING_SCALE || elapsed >= thresholds.maxInterval;
+	}
+	else
+	{
+		report = elapsed >= thresholds.heartbeat;
+	}
+
+	if (report == false)
+	{
+		skippedCount++;
+		return false;
+	}
+
+	reported = true;
+	lastLatitude = nav->latitude;
+	lastLongitude = nav->longitude;
+	lastHeading = nav->headMot;
+	lastTime = now;
+
+	return true;
+}
+
+
+// the next fix is reported whatever it is
+void ReportPolicy::reset()
+{
+	reported = false;
+}
+
+
+/**** Statistics ****/
+
+// fixes not reported since the start
+uint16_t ReportPolicy::getSkippedCount()
+{
+	return skippedCount;
+}
@@ -0,0 +1,120 @@
+/*
+ * Scheduler.cpp
+ *
+ * Cooperative scheduler built on timerNow(). Each task is a short function
+ * that must return quickly, it is called again once its period has elapsed.
+ *
+ * Author: Karim Bouanane
+ * Hardware : ATMEGA328P
+ */
+
+#include "Scheduler.h"
+
+
+Scheduler::Scheduler()
+	: count(0)
+{
+}
+
+
+/**** Tasks ****/
+
+// return the id of the task, or SCHEDULER_NO_TASK if the table is full
+uint8_t Scheduler::addTask(TaskFunction run, uint32_t period, bool enabled)
+{
+	if (count >= SCHEDULER_MAX_TASKS)
+		return SCHEDULER_NO_TASK;
+
+	tasks[count].run = run;
+	tasks[count].period = period;
+	tasks[count].lastRun = timerNow();
+	tasks[count].enabled = enabled;
+
+	return count++;
+}
+
+
+void Scheduler::enable(uint8_t id)
+{
+	if (id < count && tasks[id].enabled == false)
+	{
+		tasks[id].lastRun = timerNow();		// count a full period from now
+		tasks[id].enabled = true;
+	}
+}
+
+
+void Scheduler::disable(uint8_t id)
+{
+	if (id < count)
+		tasks[id].enabled = false;
+}
+
+
+void Scheduler::setPeriod(uint8_t id, uint32_t period)
+{
+	if (id < count)
+		tasks[id].period = period;
+}
+
+
+// the task runs at the next tick, then keeps its period from that time
+void Scheduler::runNow(uint8_t id)
+{
+	if (id < count)
+		tasks[id].lastRun = timerNow() - tasks[id].period;
+}
+
+
+/**** Execution ****/
+
+void Scheduler::tick()
+{
+	uint32_t now;
+
+	for (uint8_t i = 0; i < count; i++)
+	{
+		Task* task = &tasks[i];
+
+		if (task->enabled == false)
+			continue;
+
+		now = timerNow();
+
+		if (now - task->lastRun < task->period)
+			continue;
+
+		// keep a steady rate, unless the task is late by more than one period
+		if (task->period != 0 && now - task->lastRun < 2 * task->period)
+			task->lastRun += task->period;
+		else
+			task->lastRun = now;
+
+		task->run();
+	}
+}
+
+
+// ms till the next enabled task is due, 0 if one is already due
+uint32_t Scheduler::timeToNextRun()
+{
+	uint32_t now = timerNow();
+	uint32_t next = 0xFFFFFFFF;
+	uint32_t elapsed;
+
+	for (uint8_t i = 0; i < count; i++)
+	{
+		if (tasks[i].enabled == false)
+			continue;
+
+		elapsed = now - tasks[i].lastRun;
+
+		if (elapsed >= tasks[i].period)
+			return 0;
+
+		if (tasks[i].period - elapsed < next)
+			next = tasks[i].period - elapsed;
+	}
+
+	return next;
+}
@@ -0,0 +1,24 @@
+/*
+ * Sleep.cpp
+ *
+ * Watchdog Timer interrupt used to wake the MCU up, kept out of Sleep.h so
+ * the header can be included by several files
+ *
+ * Author: Karim Bouanane
+ * Hardware : ATMEGA328P
+ */
+
+#include "Sleep.h"
+
+volatile bool wdtWakeup = false;
+
+
+/*
+	In interrupt mode WDIE stays set and the watchdog keeps running, the
+	flag is cleared by the sleeping loop before each period
+*/
+
+ISR(WDT_vect)
+{
+	wdtWakeup = true;
+}
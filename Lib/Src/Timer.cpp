@@ -1,58 +1,115 @@
-/*
- * Timer.cpp
- *	
- * This library uses the Timer1 peripheral with interrupts
- * to give the time in ms since the first initialization of timer
- *
- * Author: Karim Bouanane
- * Hardware : ATMEGA328P
- */
-
-
-#include "Timer.h"
-
-#ifndef F_CPU
-	#define F_CPU 16000000UL
-#endif
-
-#define OCR1AH_VALUE 7		// to calculate 1 ms with clock divider = 8
-#define OCR1AL_VALUE 208   // 
-
-static volatile uint32_t count_millis; // can reach up to 4,294,967,295 milliseconds which is equivalent to 497 days
-static volatile bool enabled = false;
-
-inline static void init()
-{
-	enabled = true;
-    
-	TCCR1B |= _BV(WGM12);	// choose CTC mode
-
-    OCR1AH = OCR1AH_VALUE; 
-    OCR1AL = OCR1AL_VALUE;	// trigger overflow when 1ms is completed
-
-    TIMSK1 |= _BV(OCIE1A);	// enable timer1 interrupt for OCR mode
-
-    sei();					// enable global interrupt
-    TCCR1B |= _BV(CS11);	// choose divider 8 and start timer
-}
-
-uint32_t timerNow()
-{
-	if(enabled == false)
-		init();
-
-    uint32_t millis;
-	
-	// avoid concurrent access to count_millis variable
-	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
-	{
-		millis = count_millis;
-	}
-	
-    return millis;
-}
-
-ISR(TIMER1_COMPA_vect)
-{
-    ++count_millis;
-}
\ No newline at end of file
+/*
+ * Timer.cpp
+ *	
+ * This library uses the Timer1 peripheral free running, extended by its
+ * overflow interrupt, to give the time in ms and us since the first
+ * initialization of timer
+ *
+ * Author: Karim Bouanane
+ * Hardware : ATMEGA328P
+ */
+
+
+#include "Timer.h"
+
+#ifndef F_CPU
+	#define F_CPU 16000000UL
+#endif
+
+#define TIMER_PRESCALER		64
+#define US_PER_TICK			(TIMER_PRESCALER / (F_CPU / 1000000UL))		// 4 us
+#define US_PER_OVERFLOW		(65536UL * US_PER_TICK)						// 262144 us, about 4 interrupts per second
+
+static volatile uint32_t overflowMillis;	// ms at the last overflow, can reach up to 497 days
+static volatile uint16_t overflowFraction;	// us at the last overflow, below 1 ms
+static volatile uint32_t overflowMicros;	// us at the last overflow, wraps after 71 min
+static volatile bool enabled = false;
+
+inline static void init()
+{
+	enabled = true;
+	
+	TCCR1A = 0;					// normal mode, the counter runs from 0 to 0xFFFF
+	TCCR1B = 0;
+	TCNT1 = 0;
+	TIFR1 = _BV(TOV1);
+	
+	TIMSK1 |= _BV(TOIE1);		// enable timer1 overflow interrupt
+	
+	sei();						// enable global interrupt
+	TCCR1B = _BV(CS11) | _BV(CS10);		// choose divider 64 and start timer
+}
+
+// ms and us from the same reading of the counter
+static void timerRead(uint32_t* millis, uint32_t* micros)
+{
+	uint32_t baseMillis;
+	uint16_t fraction;
+	uint32_t baseMicros;
+	uint16_t ticks;
+	bool overflow;
+	
+	if(enabled == false)
+		init();
+	
+	// avoid concurrent access to the overflow variables
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		baseMillis = overflowMillis;
+		fraction = overflowFraction;
+		baseMicros = overflowMicros;
+		ticks = TCNT1;
+		overflow = TIFR1 & _BV(TOV1);
+	}
+	
+	// the counter wrapped after interrupts were disabled, its interrupt is still pending
+	if (overflow && ticks < 0x8000)
+	{
+		baseMicros += US_PER_OVERFLOW;
+		baseMillis += (fraction + US_PER_OVERFLOW) / 1000;
+		fraction = (fraction + US_PER_OVERFLOW) % 1000;
+	}
+	
+	*micros = baseMicros + (uint32_t)ticks * US_PER_TICK;
+	*millis = baseMillis + (fraction + (uint32_t)ticks * US_PER_TICK) / 1000;
+}
+
+uint32_t timerNow()
+{
+	uint32_t millis;
+	uint32_t micros;
+	
+	timerRead(&millis, &micros);
+	
+	return millis;
+}
+
+// us since the first initialization, wraps after 71 min, the resolution is 4 us
+uint32_t timerMicros()
+{
+	uint32_t millis;
+	uint32_t micros;
+	
+	timerRead(&millis, &micros);
+	
+	return micros;
+}
+
+// Timer1 is stopped in power-down, the time slept is added once awake
+void timerAdvance(uint32_t ms)
+{
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+	{
+		overflowMillis += ms;
+		overflowMicros += ms * 1000;
+	}
+}
+
+ISR(TIMER1_OVF_vect)
+{
+	uint32_t fraction = overflowFraction + US_PER_OVERFLOW;
+	
+	overflowMicros += US_PER_OVERFLOW;
+	overflowMillis += fraction / 1000;
+	overflowFraction = fraction % 1000;
+}
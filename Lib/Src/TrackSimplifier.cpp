@@ -0,0 +1,209 @@
+/*
+ * TrackSimplifier.cpp
+ *
+ * Online simplification of the track before it is uploaded
+ *
+ * Author: Karim Bouanane
+ * Hardware : ATMEGA328P
+ */
+
+#include <stdlib.h>
+#include "TrackSimplifier.h"
+#include "Geo.h"
+
+
+TrackSimplifier::TrackSimplifier(uint16_t error, uint32_t hold)
+	: count(0)
+	, lastEast(0)
+	, lastNorth(0)
+	, started(false)
+	, holding(false)
+	, heldSince(0)
+	, tolerance(error)
+	, maxHold(hold)
+	, removedCount(0)
+{
+}
+
+
+/**** Settings ****/
+
+// largest distance in m between a dropped fix and the simplified track
+void TrackSimplifier::setTolerance(uint16_t error)
+{
+	tolerance = error;
+}
+
+
+// ms a fix can be held before it is kept anyway, so the server doesn't lag behind
+void TrackSimplifier::setMaxHold(uint32_t hold)
+{
+	maxHold = hold;
+}
+
+
+/**** Geometry ****/
+
+static bool isInSpan(long east, long north)
+{
+	return labs(east) <= TRACK_MAX_SPAN && labs(north) <= TRACK_MAX_SPAN;
+}
+
+
+// true if every fix of the window is within the tolerance of the segment
+// from the anchor to the given offset. With offsets below TRACK_MAX_SPAN
+// the products fit in 32 bits
+bool TrackSimplifier::isCovered(long east, long north)
+{
+	uint32_t length2 = (uint32_t)(east * east) + (uint32_t)(north * north);
+	uint32_t bound = (uint32_t)tolerance * isqrt32(length2);
+	uint32_t tolerance2 = (uint32_t)tolerance * tolerance;
+	long pe;
+	long pn;
+	long dot;
+	long cross;
+	uint32_t distance2;
+
+	for (uint8_t i = 0; i < count; i++)
+	{
+		pe = points[i].east;
+		pn = points[i].north;
+		dot = pe * east + pn * north;
+
+		if (dot <= 0 || length2 == 0)
+		{
+			// behind the anchor, distance to the anchor
+			distance2 = (uint32_t)(pe * pe) + (uint32_t)(pn * pn);
+		}
+		else if ((uint32_t)dot >= length2)
+		{
+			// past the newest fix, distance to it
+			pe -= east;
+			pn -= north;
+			distance2 = (uint32_t)(pe * pe) + (uint32_t)(pn * pn);
+		}
+		else
+		{
+			// beside the segment, |cross| / length <= tolerance
+			cross = labs(east * pn - north * pe);
+
+			if ((uint32_t)cross > bound)
+				return false;
+
+			continue;
+		}
+
+		if (distance2 > tolerance2)
+			return false;
+	}
+
+	return true;
+}
+
+
+/**** Simplification ****/
+
+// the given fix is the newest of an empty window
+void TrackSimplifier::startWindow(const Fix& fix, uint32_t now)
+{
+	count = 0;
+	last = fix;
+	holding = true;
+	heldSince = now;
+
+	geoOffset(anchor.latitude, anchor.longitude, fix.latitude, fix.longitude, &lastEast, &lastNorth);
+}
+
+
+// give a new fix, return true with the kept fix when the window is closed.
+// The first fix is always kept
+bool TrackSimplifier::push(const Fix& fix, uint32_t now, Fix* kept)
+{
+	long east;
+	long north;
+
+	if (started == false)
+	{
+		anchor = fix;
+		started = true;
+		*kept = fix;
+		return true;
+	}
+
+	if (holding == false)
+	{
+		startWindow(fix, now);
+		return false;
+	}
+
+	geoOffset(anchor.latitude, anchor.longitude, fix.latitude, fix.longitude, &east, &north);
+
+	// the newest fix goes in the window if the segment to the new one still covers it
+	if (count < TRACK_WINDOW_SIZE && isInSpan(lastEast, lastNorth) && isInSpan(east, north))
+	{
+		points[count].east = lastEast;
+		points[count].north = lastNorth;
+		count++;
+
+		if (isCovered(east, north))
+		{
+			last = fix;
+			lastEast = east;
+			lastNorth = north;
+			removedCount++;
+			return false;
+		}
+
+		count--;
+	}
+
+	// keep the newest fix, the new one starts the next window
+	*kept = last;
+	anchor = last;
+	startWindow(fix, now);
+
+	return true;
+}
+
+
+// keep the newest fix if the window has been held too long
+bool TrackSimplifier::poll(uint32_t now, Fix* kept)
+{
+	if (holding == false || now - heldSince < maxHold)
+		return false;
+
+	return flush(kept);
+}
+
+
+// keep the newest fix now, the fixes dropped before it stay dropped
+bool TrackSimplifier::flush(Fix* kept)
+{
+	if (holding == false)
+		return false;
+
+	*kept = last;
+	anchor = last;
+	count = 0;
+	holding = false;
+
+	return true;
+}
+
+
+// the next fix is kept and starts a new track
+void TrackSimplifier::reset()
+{
+	count = 0;
+	started = false;
+	holding = false;
+}
+
+
+/**** Statistics ****/
+
+// fixes dropped since the start
+uint16_t TrackSimplifier::getRemovedCount()
+{
+	return removedCount;
+}
@@ -1,309 +1,428 @@
-/*
- * UbxGPS.cpp
- *
- * GPS library providing UBX protocol parsing for two type of sentences : NAV_POSLLH, NAV_STATUS
- * I took inspiration from this library :
- * https://github.com/emlid/Navio/blob/master/C%2B%2B/Navio/Ublox.cpp
- * 
- * Author: Karim Bouanane
- * Hardware : ATMEGA328P
- */
-
-#include "UBXGPS.h"
-
-
-// Debugging function
-
-inline void DebugPulse(uint8_t count)
-{
-	while (count--)
-	{
-		PORTD |= _BV(7);
-		PORTD &= ~_BV(7);
-	}
-}
-
-
-UBXGPS::UBXGPS() 
-	: validFixCount(0)
-	, invalidFixCount(0)
-	, failedChecksumCount(0)
-	, passedChecksumCount(0)
-{
-}
-
-
-/**** Initialization ****/
-
-void UBXGPS::initSerial()
-{
-	serialGPS.init(9600);
-}
-
-
-/**** Location ****/
-
-uint8_t UBXGPS::waitValidLocation()
-{
-	MssgType type;
-	
-	while(1)
-	{
-		type = getGPSMessage();
-		
-		if (type == NO_MESSAGE)					// gps module not sending any messages
-		{
-			if(isConnected() == false)			// check module connection
-			{
-				return GPS_DISCONNECTED;
-			}
-			else if (reset() == false)			// try restarting the module
-			{
-				return GPS_RESTART_FAIL;
-			}
-		}
-		else if (type == NAV_STATUS && gpsFixOK == true)	// wait for NAV_STATUS message and check gpsFix
-		{
-			if(getGPSMessage() == NAV_POSLLH)				// if Fix is acquired, extract location from NAV_POSLLH message
-				return LOCATION_FOUND;
-		}
-	}
-}
-
-
-long UBXGPS::getLatitude()
-{
-	return latitude;
-}
-
-
-long UBXGPS::getLongitude()
-{
-	return longitude;
-}
-
-
-char* UBXGPS::getStrLatitude()
-{
-	ltoa(latitude, gpsCoord.lat_str, 10);
-	return gpsCoord.lat_str;
-}
-
-
-char* UBXGPS::getStrLongitude()
-{
-	ltoa(longitude, gpsCoord.lng_str, 10);
-	return gpsCoord.lng_str;
-}
-
-
-Coord* UBXGPS::getGPSCoord()
-{
-	return &gpsCoord;
-}
-
-
-/**** Parsing ****/
-
-MssgType UBXGPS::getGPSMessage()
-{
-	resetState();
-	
-	char data;
-	bool validMssg;
-	
-	do
-	{
-		if(serialGPS.read(&data, 20000) == false)	// read one character
-			return NO_MESSAGE;						// problem with GPS module
-		
-		validMssg = encode(data);					// construct terms from read characters
-													// until reaching checksum terms
-	} while (validMssg != true);
-	
-	return (MssgType)id;
-}
-
-
-bool UBXGPS::encode(char data)
-{
-	switch (state)
-	{
-		case Sync1:
-			resetState();
-			if (data == 0xb5)
-				state = Sync2;
-		
-		return false;
-		
-		case Sync2:
-			if (data == 0x62)
-				state = Class;
-			else
-				resetState();
-		
-		return false;
-		
-		case Class:
-			id = (uint16_t)data << 8;
-			state = ID;
-		
-		break;
-
-		case ID:
-			id += data;
-			state = Length1;
-		
-		break;
-
-		case Length1:
-			payload_length = data;
-			state = Length2;
-		
-		break;
-
-		case Length2:
-			payload_length += data << 8;
-			state = Payload;
-		
-		break;
-
-		case Payload:
-			if(offset == 0)
-				resetTerms();
-		
-			termHandler(data);
-
-			offset++;
-		
-			if(offset >= payload_length)
-				state = CK_A;
-		
-		break;
-
-		case CK_A:
-		
-			if(data != calCK_A)
-			{
-				failedChecksumCount++;
-				resetState();
-			}
-			else
-			{
-				state = CK_B;
-			}
-
-		return false;
-		
-		case CK_B:
-		
-			if(data != calCK_B)
-			{
-				failedChecksumCount++;
-				resetState();
-			
-				return false;
-			}
-			else
-			{
-				passedChecksumCount++;
-				state = Done;
-			
-				return true;
-			}
-		
-		case Done:
-		default:
-			resetState();
-		break;
-	}
-	
-	calCK_A += data;
-	calCK_B += calCK_A;
-	
-	return false;
-}
-
-
-/**** Private Methods ****/
-
-void UBXGPS::resetState()
-{
-	offset = 0;
-	calCK_A = 0;
-	calCK_B = 0;
-	state = Sync1;
-}
-
-
-void UBXGPS::resetTerms()
-{
-	gpsFixOK = false;
-	latitude =  0;
-	longitude = 0;
-}
-
-
-void UBXGPS::termHandler(char data)
-{
-	switch(id)
-	{
-		case NAV_POSLLH:
-			
-			if( offset >= 12)
-			{
-				// ignore those fields
-				// Height above Ellipsoid
-				// Height above mean sea level
-				// Horizontal Accuracy Estimate
-				// Vertical Accuracy Estimate
-				break;
-			}
-			else if( offset >= 8)	// get 4 bytes for the latitude starting from the 8th byte
-			{
-				uint16_t i = offset - 8; 
-				latitude += (long)(data) << i*8;
-			}
-			else if( offset >= 4)	// get 4 bytes for the longitude starting from the 4th byte
-			{
-				uint16_t i = offset - 4; 
-				longitude += (long)(data) << i*8;
-			}
-			
-			// ignore iTOW field
-		break;
-			
-		case NAV_STATUS:
-			
-			if( offset >= 5)
-			{
-				// ignore those fields
-				// flags
-				// fixStat
-				// flags2
-				// ttff
-				// msss
-				break;
-			}
-			else if ( offset == 4)	// get 1 byte for the gpsFix in position 4
-			{	
-				// for a fix to be valid the data value need to be within the following interval 
-				//if(data >= 0x01  && data < 0x05)
-				if(data > 0x01  && data < 0x05) 
-				{
-					validFixCount++;
-					gpsFixOK = true;
-				}
-				else
-				{
-					invalidFixCount++;
-				}
-			}
-
-		break;
-			
-		default:
-			break;
-	}
-	
+/*
+ * UbxGPS.cpp
+ *
+ * GPS library providing UBX protocol parsing for three type of sentences : NAV_PVT, NAV_POSLLH, NAV_STATUS
+ * I took inspiration from this library :
+ * https://github.com/emlid/Navio/blob/master/C%2B%2B/Navio/Ublox.cpp
+ * 
+ * Author: Karim Bouanane
+ * Hardware : ATMEGA328P
+ */
+
+#include <avr/pgmspace.h>
+#include "UBXGPS.h"
+
+
+// Debugging function
+
+inline void DebugPulse(uint8_t count)
+{
+	while (count--)
+	{
+		PORTD |= _BV(7);
+		PORTD &= ~_BV(7);
+	}
+}
+
+
+/**** Decoding Table ****/
+
+// the tables are kept in flash, decode() reads them with pgm_read_*
+
+#define UBX_FIELD(offset, member)	{ offset, sizeof(((NavSolution*)0)->member), offsetof(NavSolution, member) }
+
+static const UBXField navPosllhFields[] PROGMEM =
+{
+	UBX_FIELD(0,	iTOW),
+	UBX_FIELD(4,	longitude),
+	UBX_FIELD(8,	latitude),
+	UBX_FIELD(12,	height),
+	UBX_FIELD(16,	hMSL),
+	UBX_FIELD(20,	hAcc),
+	UBX_FIELD(24,	vAcc),
+};
+
+static const UBXField navStatusFields[] PROGMEM =
+{
+	UBX_FIELD(0,	iTOW),
+	UBX_FIELD(4,	gpsFix),
+	UBX_FIELD(5,	flags),
+};
+
+static const UBXField navPvtFields[] PROGMEM =
+{
+	UBX_FIELD(0,	iTOW),
+	UBX_FIELD(4,	year),
+	UBX_FIELD(6,	month),
+	UBX_FIELD(7,	day),
+	UBX_FIELD(8,	hour),
+	UBX_FIELD(9,	min),
+	UBX_FIELD(10,	sec),
+	UBX_FIELD(11,	valid),
+	UBX_FIELD(20,	gpsFix),		// fixType
+	UBX_FIELD(21,	flags),
+	UBX_FIELD(23,	numSV),
+	UBX_FIELD(24,	longitude),
+	UBX_FIELD(28,	latitude),
+	UBX_FIELD(32,	height),
+	UBX_FIELD(36,	hMSL),
+	UBX_FIELD(40,	hAcc),
+	UBX_FIELD(44,	vAcc),
+	UBX_FIELD(48,	velN),
+	UBX_FIELD(52,	velE),
+	UBX_FIELD(60,	gSpeed),
+	UBX_FIELD(64,	headMot),
+	UBX_FIELD(68,	sAcc),
+	UBX_FIELD(72,	headAcc),
+};
+
+#define FIELD_COUNT(fields)	(sizeof(fields) / sizeof(fields[0]))
+
+static const UBXMessage messages[] PROGMEM =
+{
+	// id			length	fieldCount							fields				flags
+	{ NAV_POSLLH,	28,		FIELD_COUNT(navPosllhFields),		navPosllhFields,	0				},
+	{ NAV_STATUS,	16,		FIELD_COUNT(navStatusFields),		navStatusFields,	UBX_FIX_STATUS	},
+	{ NAV_PVT,		92,		FIELD_COUNT(navPvtFields),			navPvtFields,		UBX_FIX_STATUS	},
+};
+
+
+UBXGPS::UBXGPS() 
+	: state(Sync1)
+	, gpsFixOK(false)
+	, statusFixOK(false)
+	, lastMessageTime(0)
+	, validFixCount(0)
+	, invalidFixCount(0)
+	, failedChecksumCount(0)
+	, passedChecksumCount(0)
+{
+}
+
+
+/**** Initialization ****/
+
+void UBXGPS::initSerial()
+{
+	serialGPS.init(9600);
+}
+
+
+/**** Location ****/
+
+uint8_t UBXGPS::waitValidLocation()
+{
+	MssgType type;
+	
+	while(1)
+	{
+		type = getGPSMessage();
+		
+		if (type == NO_MESSAGE)					// gps module not sending any messages
+		{
+			if(isConnected() == false)			// check module connection
+			{
+				return GPS_DISCONNECTED;
+			}
+			else if (reset() == false)			// try restarting the module
+			{
+				return GPS_RESTART_FAIL;
+			}
+		}
+		else if (type == NAV_PVT && gpsFixOK == true)		// the whole fix comes in one NAV_PVT message
+		{
+			return LOCATION_FOUND;
+		}
+		else if (type == NAV_STATUS && gpsFixOK == true)	// wait for NAV_STATUS message and check gpsFix
+		{
+			if(getGPSMessage() == NAV_POSLLH)				// if Fix is acquired, extract location from NAV_POSLLH message
+				return LOCATION_FOUND;
+		}
+	}
+}
+
+
+// non-blocking version of waitValidLocation, parse the bytes already received
+// and return true when a valid location has been extracted
+bool UBXGPS::update()
+{
+	char data;
+	
+	while (serialGPS.isAvailable())
+	{
+		serialGPS.read(&data);
+		
+		if (encode(data) == false)
+			continue;
+		
+		resetState();					// be ready for the sync bytes of the next message
+		lastMessageTime = timerNow();
+		
+		if ((MssgType)id == NAV_PVT)
+		{
+			statusFixOK = false;
+			
+			if (gpsFixOK == true)
+			{
+				measureTimeToFix();
+				return true;
+			}
+		}
+		else if ((MssgType)id == NAV_STATUS)
+		{
+			statusFixOK = gpsFixOK;
+		}
+		else if ((MssgType)id == NAV_POSLLH && statusFixOK == true)
+		{
+			statusFixOK = false;
+			measureTimeToFix();
+			return true;
+		}
+		else
+		{
+			statusFixOK = false;		// NAV_POSLLH must directly follow NAV_STATUS
+		}
+	}
+	
+	return false;
+}
+
+
+uint32_t UBXGPS::getLastMessageTime()
+{
+	return lastMessageTime;
+}
+
+
+const NavSolution* UBXGPS::getNavSolution()
+{
+	return &nav;
+}
+
+
+// UTC time of the last NAV_PVT in seconds since 1970-01-01, 0 if not valid
+uint32_t UBXGPS::getUnixTime()
+{
+	if ((nav.valid & 0x03) != 0x03)		// validDate and validTime
+		return 0;
+	
+	// days from civil date, the year starts in March so the leap day is the last one
+	uint16_t year = nav.year - (nav.month <= 2);
+	uint8_t month = nav.month > 2 ? nav.month - 3 : nav.month + 9;
+	uint32_t days = 365UL * year + year / 4 - year / 100 + year / 400 + (153U * month + 2) / 5 + nav.day - 1 - 719468UL;
+	
+	return days * 86400UL + nav.hour * 3600UL + nav.min * 60UL + nav.sec;
+}
+
+
+long UBXGPS::getLatitude()
+{
+	return nav.latitude;
+}
+
+
+long UBXGPS::getLongitude()
+{
+	return nav.longitude;
+}
+
+
+char* UBXGPS::getStrLatitude()
+{
+	ltoa(nav.latitude, gpsCoord.lat_str, 10);
+	return gpsCoord.lat_str;
+}
+
+
+char* UBXGPS::getStrLongitude()
+{
+	ltoa(nav.longitude, gpsCoord.lng_str, 10);
+	return gpsCoord.lng_str;
+}
+
+
+Coord* UBXGPS::getGPSCoord()
+{
+	return &gpsCoord;
+}
+
+
+/**** Parsing ****/
+
+MssgType UBXGPS::getGPSMessage()
+{
+	resetState();
+	
+	char data;
+	bool validMssg;
+	
+	do
+	{
+		if(serialGPS.read(&data, 20000) == false)	// read one character
+			return NO_MESSAGE;						// problem with GPS module
+		
+		validMssg = encode(data);					// construct terms from read characters
+													// until reaching checksum terms
+	} while (validMssg != true);
+	
+	return (MssgType)id;
+}
+
+
+bool UBXGPS::encode(char data)
+{
+	switch (state)
+	{
+		case Sync1:
+			resetState();
+			if (data == 0xb5)
+				state = Sync2;
+		
+		return false;
+		
+		case Sync2:
+			if (data == 0x62)
+				state = Class;
+			else
+				resetState();
+		
+		return false;
+		
+		case Class:
+			id = (uint16_t)data << 8;
+			state = ID;
+		
+		break;
+
+		case ID:
+			id += data;
+			state = Length1;
+		
+		break;
+
+		case Length1:
+			payload_length = data;
+			state = Length2;
+		
+		break;
+
+		case Length2:
+			payload_length += data << 8;
+			state = (payload_length != 0) ? Payload : CK_A;
+		
+		break;
+
+		case Payload:
+			if(offset < UBX_MAX_PAYLOAD)
+				payload[offset] = data;		// only store, fields are extracted once the checksum is verified
+
+			offset++;
+		
+			if(offset >= payload_length)
+				state = CK_A;
+		
+		break;
+
+		case CK_A:
+		
+			if(data != calCK_A)
+			{
+				failedChecksumCount++;
+				resetState();
+			}
+			else
+			{
+				state = CK_B;
+			}
+
+		return false;
+		
+		case CK_B:
+		
+			if(data != calCK_B)
+			{
+				failedChecksumCount++;
+				resetState();
+			
+				return false;
+			}
+			else
+			{
+				passedChecksumCount++;
+				state = Done;
+				
+				if (decode() == false)
+				{
+					resetState();	// no stale fix is reported for a message not decoded
+					return false;
+				}
+			
+				return true;
+			}
+		
+		case Done:
+		default:
+			resetState();
+		break;
+	}
+	
+	calCK_A += data;
+	calCK_B += calCK_A;
+	
+	return false;
+}
+
+
+/**** Private Methods ****/
+
+void UBXGPS::resetState()
+{
+	offset = 0;
+	calCK_A = 0;
+	calCK_B = 0;
+	state = Sync1;
+}
+
+
+// copy the fields of the verified payload into nav, following the decoding table.
+// Return false for a known message whose payload is truncated or too long to be stored
+bool UBXGPS::decode()
+{
+	UBXMessage message;
+	UBXField field;
+	uint8_t i;
+	
+	for (i = 0; i < sizeof(messages) / sizeof(messages[0]); i++)
+	{
+		if (pgm_read_word(&messages[i].id) == id)
+			break;
+	}
+	
+	if (i == sizeof(messages) / sizeof(messages[0]))
+		return true;	// unknown message, nothing to decode
+	
+	memcpy_P(&message, &messages[i], sizeof(message));
+	
+	if (payload_length < message.length || payload_length > UBX_MAX_PAYLOAD)
+		return false;	// truncated or oversized message
+	
+	for (i = 0; i < message.fieldCount; i++)
+	{
+		memcpy_P(&field, &message.fields[i], sizeof(field));
+		memcpy((uint8_t*)&nav + field.target, &payload[field.offset], field.size);
+	}
+	
+	if (message.flags & UBX_FIX_STATUS)
+	{
+		// for a fix to be valid the gpsFix value need to be 2D, 3D or GPS + dead reckoning
+		// and the receiver must flag it within the DOP and accuracy masks (gpsFixOk)
+		gpsFixOK = (nav.gpsFix > 0x01 && nav.gpsFix < 0x05) && (nav.flags & 0x01);
+		
+		if (gpsFixOK)
+			validFixCount++;
+		else
+			invalidFixCount++;
+	}
+	
+	return true;
 }
\ No newline at end of file
@@ -0,0 +1,190 @@
+/*
+ * UDPWindow.cpp
+ *
+ * Fixes sent as UDP datagrams and not acknowledged yet, with selective
+ * retransmission of the lost ones
+ *
+ * Author: Karim Bouanane
+ * Hardware : ATMEGA328P
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "UDPWindow.h"
+#include "FixCodec.h"
+
+
+UDPWindow::UDPWindow(uint32_t timeout)
+	: count(0)
+	, nextSeq(0)
+	, session(0)
+	, retryTimeout(timeout)
+	, droppedCount(0)
+	, retransmitCount(0)
+{
+}
+
+
+/**** Settings ****/
+
+// ms without acknowledgment before a datagram is sent again
+void UDPWindow::setRetryTimeout(uint32_t timeout)
+{
+	retryTimeout = timeout;
+}
+
+
+// different at each start of the tracker, the boot count of the EEPROM
+void UDPWindow::setSession(uint16_t id)
+{
+	session = id;
+}
+
+
+/**** Window ****/
+
+void UDPWindow::push(const Fix& fix)
+{
+	if (count == UDP_WINDOW_SIZE)
+	{
+		remove(0);				// keep the most recent fixes
+		droppedCount++;
+	}
+
+	slots[count].fix = fix;
+	slots[count].sentAt = 0;
+	slots[count].seq = nextSeq++;
+	slots[count].sendCount = 0;
+	slots[count].missing = false;
+	count++;
+}
+
+
+void UDPWindow::acknowledge(uint16_t seq, uint32_t bitmap)
+{
+	uint8_t i = 0;
+	int16_t distance;
+	bool received;
+
+	while (i < count)
+	{
+		distance = (int16_t)(seq - slots[i].seq);
+
+		if (distance == 0)
+			received = true;
+		else if (distance > 0 && distance <= UDP_ACK_BITS)
+			received = (bitmap >> (distance - 1)) & 1;
+		else
+			received = false;
+
+		if (received)
+		{
+			remove(i);
+			continue;
+		}
+
+		// out of the bitmap, it would be sent again on every acknowledgment
+		if (distance > UDP_ACK_BITS)
+		{
+			remove(i);
+			droppedCount++;
+			continue;
+		}
+
+		// older than an acknowledged datagram, it was lost on the way
+		if (distance > 0 && slots[i].sendCount != 0)
+			slots[i].missing = true;
+
+		i++;
+	}
+}
+
+
+// return the datagram to send now, oldest first, or NULL if none is due.
+// The datagram is counted as sent, it must be sent right away
+const Datagram* UDPWindow::next(uint32_t now)
+{
+	Datagram* datagram;
+
+	for (uint8_t i = 0; i < count; i++)
+	{
+		datagram = &slots[i];
+
+		if (datagram->sendCount != 0 && datagram->missing == false && now - datagram->sentAt < retryTimeout)
+			continue;
+
+		if (datagram->sendCount != 0)
+			retransmitCount++;
+
+		if (datagram->sendCount < 0xFF)
+			datagram->sendCount++;
+
+		datagram->sentAt = now;
+		datagram->missing = false;
+		return datagram;
+	}
+
+	return NULL;
+}
+
+
+uint8_t UDPWindow::getCount()
+{
+	return count;
+}
+
+
+void UDPWindow::remove(uint8_t index)
+{
+	count--;
+
+	for (uint8_t i = index; i < count; i++)
+		slots[i] = slots[i + 1];
+}
+
+
+/**** Datagram ****/
+
+// write "i=<id>&k=<session>&s=<seq>&p=<fix>", return its length or 0 if it does not fit
+size_t UDPWindow::format(const Datagram* datagram, const char* id, char* buff, size_t len)
+{
+	FixEncoder encoder;
+	char key[6];
+	char seq[6];
+	size_t length;
+
+	utoa(session, key, 10);
+	utoa(datagram->seq, seq, 10);
+
+	length = strlen("i=") + strlen(id) + strlen("&k=") + strlen(key) + strlen("&s=") + strlen(seq) + strlen("&");
+
+	if (length >= len)
+		return 0;
+
+	strcpy(buff, "i=");
+	strcat(buff, id);
+	strcat(buff, "&k=");
+	strcat(buff, key);
+	strcat(buff, "&s=");
+	strcat(buff, seq);
+	strcat(buff, "&");
+
+	if (encoder.begin(buff + length, len - length) == false || encoder.add(datagram->fix) == false)
+		return 0;
+
+	return length + encoder.end();
+}
+
+
+/**** Statistics ****/
+
+uint16_t UDPWindow::getDroppedCount()
+{
+	return droppedCount;
+}
+
+
+uint16_t UDPWindow::getRetransmitCount()
+{
+	return retransmitCount;
+}
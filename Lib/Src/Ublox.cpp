@@ -1,101 +1,308 @@
-/*
- * Ublox.cpp
- *
- * Ublox-M8
- *
- * Author: Karim Bouanane
- * Hardware : Atmega328p
- */ 
-
-#include "Ublox.h"
-
-
-/**** Definitions ****/
-
-#define CHIP_ID_CMD_SIZE sizeof(chipID_cmd)
-#define CHIP_ID_RESP_SIZE sizeof(chipID_resp)
-
-#define RESET_CMD_SIZE sizeof(reset_cmd)
-#define RESET_RESP_SIZE sizeof(reset_resp)
-
-#define NAV_POSSLH_CMD_SIZE sizeof(nav_posllh_cmd)
-#define NAV_POSSLH_RESP_SIZE sizeof(nav_posllh_resp)
-
-#define NAV_STATUS_CMD_SIZE sizeof(nav_status_cmd)
-#define NAV_STATUS_RESP_SIZE sizeof(nav_status_resp)
-
-
-/**** Constants ****/
-
-const char chipID_cmd[] = {0xB5,0x62,0x27,0x03,0x00,0x00,0x2A,0xA5};
-const char chipID_resp[] = {0xB5,0x62,0x27,0x03}; // we don't need complete response to verify the connection
-
-const char reset_cmd[] = {0xB5, 0x62, 0x06, 0x17, 0x14, 0x00, 0x00, 0x40, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x74, 0x44};
-const char reset_resp[] = {'$', 'G', 'N', 'T', 'X', 'T'};
-	
-const char nav_posllh_cmd[] = {0xB5, 0x62, 0x06, 0x01, 0x03, 0x00, 0x01, 0x02, 0x01, 0x0E, 0x47};
-const char nav_posllh_resp[] = {0xB5, 0x62, 0x05, 0x01, 0x02, 0x00, 0x06, 0x01, 0x0F, 0x38};
-
-const char nav_status_cmd[] = {0xB5, 0x62, 0x06, 0x01, 0x03, 0x00, 0x01, 0x03, 0x01, 0x0F, 0x49};
-const char nav_status_resp[] = {0xB5, 0x62, 0x01, 0x03};
-	
-
-// Debugging function
-
-inline void DebugPulse(uint8_t count)
-{
-	while (count--)
-	{
-		PORTD |= _BV(7);
-		PORTD &= ~_BV(7);
-	}
-}
-
-
-uint8_t Ublox::sendReceive(const char* cmd, size_t cmdLength, const char* resp, size_t respLength, uint32_t timeout)
-{
-	serialGPS.sendBytes(cmd, cmdLength);
-	return serialGPS.find(resp, respLength, timeout);
-}
-
-
-uint8_t Ublox::isConnected()
-{	
-	if(sendReceive(chipID_cmd, CHIP_ID_CMD_SIZE, chipID_resp, CHIP_ID_RESP_SIZE, 4000) == false)
-		return GPS_DISCONNECTED;
-	
-	return GPS_SUCCESS_REPLY;
-}
-
-
-uint8_t Ublox::reset()
-{
-	if(sendReceive(reset_cmd, RESET_CMD_SIZE, reset_resp, RESET_RESP_SIZE, 4000) == false)
-		return GPS_RESTART_FFAIL;
-		
-	return GPS_SUCCESS_REPLY;
-}
-
-
-uint8_t Ublox::enableMessage(MssgType type)
-{
-	switch(type)
-	{
-		case NAV_POSLLH:
-		
-			return sendReceive(nav_posllh_cmd, NAV_POSSLH_CMD_SIZE, nav_posllh_resp, NAV_POSSLH_RESP_SIZE, 2000);
-				
-		break;
-		
-		case NAV_STATUS:
-		
-			return sendReceive(nav_status_cmd, NAV_STATUS_CMD_SIZE, nav_status_resp, NAV_STATUS_RESP_SIZE, 2000);
-	
-		break;
-		
-		default:
-		break;	
-	}
-	
-	return false;
-}
\ No newline at end of file
+/*
+ * Ublox.cpp
+ *
+ * Ublox-M8
+ *
+ * Author: Karim Bouanane
+ * Hardware : Atmega328p
+ */ 
+
+#include "Ublox.h"
+#include "Timer.h"
+
+
+/**** Definitions ****/
+
+#define CHIP_ID_CMD_SIZE sizeof(chipID_cmd)
+#define CHIP_ID_RESP_SIZE sizeof(chipID_resp)
+
+#define RESET_CMD_SIZE sizeof(reset_cmd)
+#define RESET_RESP_SIZE sizeof(reset_resp)
+
+#define ACK_NAK		0x0500
+#define ACK_ACK		0x0501
+#define CFG_MSG		0x0601
+#define CFG_RXM		0x0611
+#define CFG_PM2		0x063B
+#define RXM_PMREQ	0x0241
+
+#define PMREQ_BACKUP		0x00000002UL	// flags
+#define PMREQ_FORCE			0x00000004UL
+#define PMREQ_WAKE_UARTRX	0x00000008UL	// wakeupSources
+
+#define PM2_UPDATE_EPH		0x00001000UL	// keep the ephemeris up to date for the hot starts
+#define PM2_CYCLIC			0x00020000UL	// cyclic tracking, not ON/OFF
+
+#define RXM_CONTINUOUS		0
+#define RXM_POWER_SAVE		1
+
+#define WAKEUP_RETRY		3		// chip id polls after the wakeup byte
+#define ACK_TIMEOUT			2000	// ms for the reply to a CFG message
+
+
+/**** Constants ****/
+
+const char chipID_cmd[] = {0xB5,0x62,0x27,0x03,0x00,0x00,0x2A,0xA5};
+const char chipID_resp[] = {0xB5,0x62,0x27,0x03}; // we don't need complete response to verify the connection
+
+const char reset_cmd[] = {0xB5, 0x62, 0x06, 0x17, 0x14, 0x00, 0x00, 0x40, 0x00, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x74, 0x44};
+const char reset_resp[] = {'$', 'G', 'N', 'T', 'X', 'T'};
+	
+
+// Debugging function
+
+inline void DebugPulse(uint8_t count)
+{
+	while (count--)
+	{
+		PORTD |= _BV(7);
+		PORTD &= ~_BV(7);
+	}
+}
+
+
+Ublox::Ublox()
+	: asleep(false)
+	, waitingFix(false)
+	, wakeupTime(0)
+	, timeToFix(0)
+	, averageTimeToFix(0)
+	, ttffHandler(NULL)
+{
+}
+
+
+uint8_t Ublox::sendReceive(const char* cmd, size_t cmdLength, const char* resp, size_t respLength, uint32_t timeout)
+{
+	serialGPS.sendBytes(cmd, cmdLength);
+	return serialGPS.find(resp, respLength, timeout);
+}
+
+
+uint8_t Ublox::isConnected()
+{	
+	if(sendReceive(chipID_cmd, CHIP_ID_CMD_SIZE, chipID_resp, CHIP_ID_RESP_SIZE, 4000) == false)
+		return GPS_DISCONNECTED;
+	
+	return GPS_SUCCESS_REPLY;
+}
+
+
+uint8_t Ublox::reset()
+{
+	if(sendReceive(reset_cmd, RESET_CMD_SIZE, reset_resp, RESET_RESP_SIZE, 4000) == false)
+		return GPS_RESTART_FFAIL;
+		
+	return GPS_SUCCESS_REPLY;
+}
+
+
+void Ublox::sendUBX(uint16_t id, const uint8_t* payload, uint16_t length)
+{
+	uint8_t header[4] = { (uint8_t)(id >> 8), (uint8_t)id, (uint8_t)length, (uint8_t)(length >> 8) };
+	uint8_t ck_a = 0;
+	uint8_t ck_b = 0;
+	
+	// Fletcher checksum over class, id, length and payload
+	for (uint8_t i = 0; i < sizeof(header); i++)
+	{
+		ck_a += header[i];
+		ck_b += ck_a;
+	}
+	
+	for (uint16_t i = 0; i < length; i++)
+	{
+		ck_a += payload[i];
+		ck_b += ck_a;
+	}
+	
+	serialGPS.send(0xB5);
+	serialGPS.send(0x62);
+	serialGPS.sendBytes((const char*)header, sizeof(header));
+	serialGPS.sendBytes((const char*)payload, length);
+	serialGPS.send(ck_a);
+	serialGPS.send(ck_b);
+}
+
+
+// wait for the reply to the CFG message id, the ACK and NAK of other
+// messages are skipped. Return false on ACK-NAK or timeout
+bool Ublox::waitAck(uint16_t id, uint32_t timeout)
+{
+	// header and payload : class, id, length 2, acknowledged class and id
+	const char ack[8] = { (char)0xB5, 0x62, (char)(ACK_ACK >> 8), (char)ACK_ACK, 0x02, 0x00, (char)(id >> 8), (char)id };
+	const char nak[8] = { (char)0xB5, 0x62, (char)(ACK_NAK >> 8), (char)ACK_NAK, 0x02, 0x00, (char)(id >> 8), (char)id };
+	
+	return serialGPS.findOneOf(ack, sizeof(ack), nak, sizeof(nak), timeout) == 1;
+}
+
+
+uint8_t Ublox::setMessageRate(MssgType type, uint8_t rate)
+{
+	// CFG-MSG: message class, message id, rate on the current port
+	const uint8_t payload[3] = { (uint8_t)(type >> 8), (uint8_t)type, rate };
+	
+	sendUBX(CFG_MSG, payload, sizeof(payload));
+	return waitAck(CFG_MSG, ACK_TIMEOUT);
+}
+
+
+uint8_t Ublox::enableMessage(MssgType type)
+{
+	if(type == NO_MESSAGE)
+		return false;
+	
+	return setMessageRate(type, 1);		// one message per navigation solution
+}
+
+
+uint8_t Ublox::disableMessage(MssgType type)
+{
+	if(type == NO_MESSAGE)
+		return false;
+	
+	return setMessageRate(type, 0);
+}
+
+
+/**** Power ****/
+
+// UBX is little endian
+static void putU4(uint8_t* buff, uint32_t value)
+{
+	for (uint8_t i = 0; i < 4; i++)
+	{
+		buff[i] = value;
+		value >>= 8;
+	}
+}
+
+
+// backup mode for duration ms, or till the next byte received when 0. The RTC
+// and the ephemeris are kept in the battery backed RAM, so the next fix is a
+// hot start if V_BCKP is supplied. RXM-PMREQ isn't acknowledged
+uint8_t Ublox::sleep(uint32_t duration)
+{
+	// RXM-PMREQ version 0 : version, reserved[3], duration, flags, wakeupSources
+	uint8_t payload[16] = { 0 };
+	
+	putU4(&payload[4], duration);
+	putU4(&payload[8], PMREQ_BACKUP | PMREQ_FORCE);
+	putU4(&payload[12], PMREQ_WAKE_UARTRX);
+	
+	sendUBX(RXM_PMREQ, payload, sizeof(payload));
+	serialGPS.flush();
+	
+	asleep = true;
+	waitingFix = false;
+	
+	return GPS_SUCCESS_REPLY;
+}
+
+
+// the first byte received wakes the module up but is lost, the chip id is
+// polled till the module answers, then the time to first fix is measured
+uint8_t Ublox::wakeup()
+{
+	uint8_t status = GPS_DISCONNECTED;
+	
+	serialGPS.send(0xFF);
+	
+	for (uint8_t i = 0; i < WAKEUP_RETRY && status != GPS_SUCCESS_REPLY; i++)
+	{
+		if (sendReceive(chipID_cmd, CHIP_ID_CMD_SIZE, chipID_resp, CHIP_ID_RESP_SIZE, 1000) == true)
+			status = GPS_SUCCESS_REPLY;
+	}
+	
+	asleep = false;
+	waitingFix = true;
+	wakeupTime = timerNow();
+	
+	return status;
+}
+
+
+// cyclic tracking : a fix every updatePeriod ms, tracking for onTime s, a new
+// search every searchPeriod ms when the signal is lost
+uint8_t Ublox::setPowerSave(uint32_t updatePeriod, uint32_t searchPeriod, uint16_t onTime)
+{
+	// CFG-PM2 version 1 : version, reserved, maxStartupStateDur, reserved, flags,
+	// updatePeriod, searchPeriod, gridOffset, onTime, minAcqTime, reserved[20]
+	uint8_t pm2[44] = { 0x01 };
+	const uint8_t rxm[2] = { 0x08, RXM_POWER_SAVE };	// reserved, lpMode
+	
+	putU4(&pm2[4], PM2_UPDATE_EPH | PM2_CYCLIC);
+	putU4(&pm2[8], updatePeriod);
+	putU4(&pm2[12], searchPeriod);
+	pm2[20] = onTime;
+	pm2[21] = onTime >> 8;
+	
+	sendUBX(CFG_PM2, pm2, sizeof(pm2));
+	
+	if (waitAck(CFG_PM2, ACK_TIMEOUT) == false)
+		return false;
+	
+	sendUBX(CFG_RXM, rxm, sizeof(rxm));
+	return waitAck(CFG_RXM, ACK_TIMEOUT);
+}
+
+
+uint8_t Ublox::setContinuous()
+{
+	const uint8_t rxm[2] = { 0x08, RXM_CONTINUOUS };
+	
+	sendUBX(CFG_RXM, rxm, sizeof(rxm));
+	return waitAck(CFG_RXM, ACK_TIMEOUT);
+}
+
+
+bool Ublox::isAsleep()
+{
+	return asleep;
+}
+
+
+/**** Time To First Fix ****/
+
+// called by the parser on each valid fix
+void Ublox::measureTimeToFix()
+{
+	if (waitingFix == false)
+		return;
+	
+	waitingFix = false;
+	timeToFix = timerNow() - wakeupTime;
+	
+	if (averageTimeToFix == 0)
+		averageTimeToFix = timeToFix;
+	else
+		averageTimeToFix += ((int32_t)timeToFix - (int32_t)averageTimeToFix) / 8;
+	
+	if (ttffHandler != NULL)
+		ttffHandler(timeToFix);
+}
+
+
+bool Ublox::isWaitingFix()
+{
+	return waitingFix;
+}
+
+
+// ms from the wakeup to the first valid fix
+uint32_t Ublox::getTimeToFix()
+{
+	return timeToFix;
+}
+
+
+uint32_t Ublox::getAverageTimeToFix()
+{
+	return averageTimeToFix;
+}
+
+
+void Ublox::setTTFFHandler(TTFFHandler handler)
+{
+	ttffHandler = handler;
+}
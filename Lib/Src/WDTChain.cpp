@@ -0,0 +1,89 @@
+/*
+ * WDTChain.cpp
+ *
+ * Accounting of the chained watchdog periods
+ *
+ * Author: Karim Bouanane
+ * Hardware : ATMEGA328P
+ */
+
+#include "WDTChain.h"
+
+
+WDTChain::WDTChain()
+	: calibration(WDT_NOMINAL)
+	, remainder(0)
+{
+}
+
+
+/**** Calibration ****/
+
+// the watchdog oscillator is within 10 % of its nominal frequency, a
+// measure farther than twice off is wrong and would overflow the periods
+void WDTChain::setCalibration(uint16_t ms)
+{
+	if (ms < WDT_NOMINAL / 2)
+		ms = WDT_NOMINAL / 2;
+	else if (ms > WDT_NOMINAL * 2)
+		ms = WDT_NOMINAL * 2;
+
+	calibration = ms;
+}
+
+
+uint16_t WDTChain::getCalibration()
+{
+	return calibration;
+}
+
+
+/**** Chain ****/
+
+// us of a watchdog period, 16 ms << index nominal, 1/64 of the calibration
+uint32_t WDTChain::periodMicros(uint8_t index)
+{
+	return ((uint32_t)calibration * 1000 << index) >> 6;
+}
+
+
+// the longest period ending before the deadline, left ms from now. The us
+// already slept and not credited yet are taken off, WDT_CHAIN_DONE if even
+// the shortest period doesn't fit
+uint8_t WDTChain::next(int32_t left)
+{
+	uint32_t budget;
+	uint8_t index = WDT_PERIODS;
+
+	if (left <= 0)
+		return WDT_CHAIN_DONE;
+
+	// saturated past an hour
+	budget = left < 3600000L ? (uint32_t)left * 1000 - remainder : 3600000000UL;
+
+	while (index-- > 0)
+	{
+		if (periodMicros(index) <= budget)
+			return index;
+	}
+
+	return WDT_CHAIN_DONE;
+}
+
+
+// ms to credit for a period slept, the us below 1 ms are carried
+uint16_t WDTChain::credit(uint8_t index)
+{
+	uint32_t period = periodMicros(index);
+	uint16_t ms = period / 1000;
+
+	remainder += period % 1000;
+
+	if (remainder >= 1000)
+	{
+		remainder -= 1000;
+		ms++;
+	}
+
+	return ms;
+}
@@ -0,0 +1,86 @@
+/*
+ * matcher.h
+ *
+ * Streaming matcher that watches several patterns at once in a single pass
+ * over the received bytes. Each pattern runs its own KMP automaton, so on a
+ * mismatch the match falls back to the longest prefix already seen instead
+ * of restarting from the beginning ("OOK\r\n" does match "OK\r\n").
+ *
+ * Author: Karim Bouanane
+ * Hardware: ATMEGA328P
+ */
+
+#ifndef MATCHER_H_
+#define MATCHER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+
+#ifndef MATCHER_MAX_PATTERNS
+	#define MATCHER_MAX_PATTERNS	4	// patterns watched at the same time by default
+#endif
+
+#ifndef MATCHER_MAX_LENGTH
+	#define MATCHER_MAX_LENGTH		24	// longest pattern, size of each failure table
+#endif
+
+#define MATCHER_NO_MATCH	0
+
+
+// one pattern and its automaton
+typedef struct
+{
+	const char *pattern;
+	uint8_t length;
+	uint8_t matched;								// current state of the automaton
+	uint8_t failure[MATCHER_MAX_LENGTH];			// longest proper prefix which is also a suffix
+
+} MatcherPattern;
+
+
+// The automata are kept by the derived SizedMatcher, which gives room for
+// the patterns actually watched : a matcher built on the stack for one
+// pattern doesn't pay for four
+class StreamMatcher
+{
+
+private:	// private variables
+
+	MatcherPattern *slots;
+	uint8_t capacity;
+	uint8_t count;
+
+protected:	// protected methods
+
+	StreamMatcher(MatcherPattern *slots, uint8_t capacity);
+
+public:		// public methods
+
+	// patterns
+	bool add(const char *target);
+	bool add(const char *target, size_t len);
+	void clear();
+	uint8_t getCount();
+
+	// matching
+	void reset();
+	uint8_t feed(char data);
+};
+
+
+template <uint8_t Patterns = MATCHER_MAX_PATTERNS>
+class SizedMatcher : public StreamMatcher
+{
+
+private:	// private variables
+
+	MatcherPattern storage[Patterns];
+
+public:		// public methods
+
+	SizedMatcher() : StreamMatcher(storage, Patterns) {}
+};
+
+#endif /* MATCHER_H_ */
@@ -0,0 +1,88 @@
+/*
+ * ringbuffer.h
+ *
+ * Fixed size byte FIFO shared between an interrupt service routine (producer)
+ * and the main program (consumer). Each side only writes its own index, so no
+ * locking is needed as long as there is one producer and one consumer.
+ *
+ * Author: Karim Bouanane
+ * Hardware: ATMEGA328P
+ */
+
+#ifndef RINGBUFFER_H_
+#define RINGBUFFER_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <util/atomic.h>
+
+template <uint8_t SIZE>
+class RingBuffer
+{
+	// the index mask only works for power of two sizes
+	static_assert(SIZE >= 2 && SIZE <= 128 && (SIZE & (SIZE - 1)) == 0, "RingBuffer SIZE must be a power of two between 2 and 128");
+
+private:	// private variables
+
+	volatile uint8_t buffer[SIZE];
+	volatile uint8_t head;			// next position to write, owned by the producer
+	volatile uint8_t tail;			// next position to read, owned by the consumer
+	volatile uint16_t overflowCount;	// bytes dropped because the buffer was full
+
+public:		// public methods
+
+	RingBuffer() : head(0), tail(0), overflowCount(0) {}
+
+	// producer side, return false and count the byte as lost if the buffer is full
+	inline bool push(uint8_t data)
+	{
+		uint8_t next = (head + 1) & (SIZE - 1);
+
+		if (next == tail)
+		{
+			overflowCount++;
+			return false;
+		}
+
+		buffer[head] = data;
+		head = next;
+		return true;
+	}
+
+	// consumer side, return false if there is nothing to read
+	inline bool pop(uint8_t *data)
+	{
+		uint8_t t = tail;
+
+		if (t == head)
+			return false;
+
+		*data = buffer[t];
+		tail = (t + 1) & (SIZE - 1);
+		return true;
+	}
+
+	inline bool isEmpty() const { return head == tail; }
+
+	inline bool isFull() const { return ((head + 1) & (SIZE - 1)) == tail; }
+
+	inline uint8_t count() const { return (head - tail) & (SIZE - 1); }
+
+	// discard unread data, must be called from the consumer side
+	inline void clear() { tail = head; }
+
+	inline uint16_t getOverflowCount() const
+	{
+		uint16_t overflow;
+
+		// the counter is 16 bits wide and updated from the interrupt
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE)
+		{
+			overflow = overflowCount;
+		}
+
+		return overflow;
+	}
+};
+
+#endif /* RINGBUFFER_H_ */
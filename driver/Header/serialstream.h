@@ -0,0 +1,178 @@
+/*
+ * serialstream.h
+ *
+ * Blocking i/o with timeout shared by the serial ports. A port derives from
+ * SerialStream<Port> and gives the two byte primitives :
+ *
+ *		void send(char data);			// queue one byte, wait for a free place
+ *		bool tryRead(char *data);		// pop one received byte, false if there is none
+ *
+ * The strings, the reading with timeout and the matching are written once
+ * here. tryRead() is defined in the header of the port, so the compiler
+ * inlines it in the loops waiting for the bytes.
+ *
+ * Author: Karim Bouanane
+ * Hardware: ATMEGA328P
+ */
+
+#ifndef SERIALSTREAM_H_
+#define SERIALSTREAM_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include "Timer.h"
+#include "matcher.h"
+
+#define MAX_DELAY 0xFFFFFFFF
+
+
+template <class Port>
+class SerialStream
+{
+
+private:	// private methods
+
+	inline Port& port() { return *static_cast<Port*>(this); }
+
+	// wait for a byte till the deadline (prev + timeout) is reached
+	inline bool waitByte(char *data, uint32_t prev, uint32_t timeout)
+	{
+		while (port().tryRead(data) == false)
+		{
+			if (timerNow() - prev > timeout)	// be sure not exceed the timeout
+				return false;					// timeout is reached
+		}
+
+		return true;
+	}
+
+public:		// public methods
+
+	/**** Send data methods ****/
+
+	void sendString(const char *message)
+	{
+		while (*message != '\0')
+			port().send(*message++);
+	}
+
+	void sendString(const char *message, size_t len)
+	{
+		while (len-- && *message != '\0')
+			port().send(*message++);
+	}
+
+	void sendBytes(const char* bytes, size_t len)
+	{
+		while (len--)
+			port().send(*bytes++);
+	}
+
+
+	/**** Read data methods ****/
+
+	bool read(char *data, uint32_t timeout = MAX_DELAY)
+	{
+		return waitByte(data, timerNow(), timeout);
+	}
+
+	size_t readString(char *buff, size_t len, uint32_t timeout = MAX_DELAY)
+	{
+		return readStringUntil('\n', buff, len, timeout);
+	}
+
+	size_t readBytes(char *buff, size_t len, uint32_t timeout = MAX_DELAY)
+	{
+		size_t i = len;
+
+		while (len--)	// decrement until reaching 0
+		{
+			if (read(buff, timeout) == false)
+				break;	// timeout is reached
+
+			++buff;		// move to the next address in buff array
+		}
+
+		return i - len; // return number of read characters
+	}
+
+	size_t readStringUntil(char terminator, char *buff, size_t len, uint32_t timeout = MAX_DELAY)
+	{
+		size_t i = len;
+
+		while (len--) // decrement until reaching 0
+		{
+			if (read(buff, timeout) == false)
+				return 0; // timeout is reached
+
+			if (*buff == terminator) // verify string terminator
+			{
+				++buff; // include terminator in buffer
+				break;
+			}
+			else
+				++buff; // move to the next address in buff array
+		}
+
+		*buff = 0;      // close array
+		return i - len; // return number of read characters
+	}
+
+
+	/**** Find data methods ****/
+
+	bool find(const char *target, uint32_t timeout = MAX_DELAY)
+	{
+		return find(target, strlen(target), timeout);
+	}
+
+	bool find(const char *target, size_t len, uint32_t timeout = MAX_DELAY)
+	{
+		SizedMatcher<1> matcher;
+
+		if (matcher.add(target, len) == false)
+			return false;	// target is too long for the matcher
+
+		return findAny(matcher, timeout) != MATCHER_NO_MATCH;
+	}
+
+	uint8_t findOneOf(const char *target1, const char *target2, uint32_t timeout = MAX_DELAY)
+	{
+		return findOneOf(target1, strlen(target1), target2, strlen(target2), timeout);
+	}
+
+	uint8_t findOneOf(const char *target1, size_t len1, const char *target2, size_t len2, uint32_t timeout = MAX_DELAY)
+	{
+		SizedMatcher<2> matcher;
+
+		if (matcher.add(target1, len1) == false || matcher.add(target2, len2) == false)
+			return 0;		// targets are too long for the matcher
+
+		return findAny(matcher, timeout);
+	}
+
+	// return the number of the pattern found, 0 on timeout
+	uint8_t findAny(StreamMatcher &matcher, uint32_t timeout = MAX_DELAY)
+	{
+		uint32_t prev = timerNow();
+		uint8_t found;
+		char data;
+
+		matcher.reset();
+
+		do
+		{
+			if (waitByte(&data, prev, timeout) == false)
+				return MATCHER_NO_MATCH;	// timeout is reached
+
+			found = matcher.feed(data);		// all patterns advance with the same byte
+
+		} while (found == MATCHER_NO_MATCH);
+
+		return found;
+	}
+};
+
+#endif /* SERIALSTREAM_H_ */
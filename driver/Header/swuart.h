@@ -1,85 +1,133 @@
-/*
- * softuart.h
- *
- * Software UART (bit-banging) driver, blocking i/o with timeout
- *
- * Author: Karim Bouanane
- * Hardware: ATMEGA328P
- */
-
-#ifndef SWUART_H_
-#define SWUART_H_
-
-#include <avr/io.h>
-#include <stddef.h>
-#include <stdbool.h>
-#include <string.h>
-#include <avr/interrupt.h>
-#include "Timer.h"
-
-
-#define BR_9600     // Desired baudrate
-
-//This section chooses the correct timer values for the chosen baudrate.
-#ifdef  BR_9600
-	#define TICKS2COUNT         25  //!< Ticks between two bits.
-	#define TICKS2WAITONE       25  //!< Wait one bit period.
-	#define TICKS2WAITONE_HALF  38  //!< Wait one and a half bit period.
-#endif
-
-//Some IO, timer and interrupt specific defines.
-#define ENABLE_EXTERNAL0_INTERRUPT()	(EIMSK |= _BV(INT0))
-#define DISABLE_EXTERNAL0_INTERRUPT()	(EIMSK &= ~_BV(INT0))
-#define ENABLE_INT0_FALLINGEDGE()		(EICRA |= _BV(ISC01))
-#define CLEAR_INT0_INTERRUPT()			(EIFR |= _BV(INTF0))
-
-#define ENABLE_TIMER_INTERRUPT()		(TIMSK0 |= _BV(OCIE0A))
-#define DISABLE_TIMER_INTERRUPT()		(TIMSK0 &= ~_BV(OCIE0A))
-#define CLEAR_TIMER_INTERRUPT()			(TIFR0 |= _BV(OCF0A))
-#define RESET_TIMER_PRESCALAR()			(TCCR0B &= ~(_BV(CS01) | _BV(CS00)))
-#define SET_TIMER_PRESCALAR()			(TCCR0B |= _BV(CS01) | _BV(CS00))
-
-#define TX_PIN				PORTD3	// Transmit data pin, could be any digital pin
-#define RX_PIN				PORTD2	// Receive data pin, must be INT0
-#define SET_TX_PIN()		(PORTD |= _BV(TX_PIN))
-#define CLEAR_TX_PIN()		(PORTD &= ~_BV(TX_PIN))
-#define GET_RX_PIN()		(PIND & _BV(RX_PIN))
-
-#define MAX_DELAY 0xFFFFFFFF
-
-class SWUART
-{
-	
-public:	// public variables
-
-    static uint16_t bit_period;
-    static uint16_t bit_half_period;
-	
-public:	// public methods
-
-	// settings
-    void init(uint32_t baud = 9600);
-    void setBaud(uint32_t baud);
-	
-	// send data
-    void send(char data);
-    void sendString(const char *message);
-    void sendString(const char *message, size_t len);
-	void sendBytes(const char* bytes, size_t len);
-	
-	// read data
-	void flush();
-	bool isAvailable();
-    bool read(char *data, uint32_t timeout = MAX_DELAY);
-    size_t readString(char *buff, size_t len, uint32_t timeout = MAX_DELAY);
-	size_t readBytes(char *bytes, size_t len, uint32_t timeout = MAX_DELAY);
-	size_t readStringUntil(char terminator, char *buff, size_t len, uint32_t timeout = MAX_DELAY);
-	
-	// find data
-	bool find(const char *target, uint32_t timeout = MAX_DELAY);
-	bool find(const char *target, size_t len, uint32_t timeout = MAX_DELAY);
-	uint8_t findOneOf(const char *target1, const char *target2, uint32_t timeout = MAX_DELAY);
-	uint8_t findOneOf(const char *target1, size_t len1, const char *target2, size_t len2, uint32_t timeout = MAX_DELAY);
-};
-
+/*
+ * softuart.h
+ *
+ * Software UART (bit-banging) driver, received and transmitted bytes are
+ * queued into FIFOs served by the interrupts, blocking i/o with timeout
+ *
+ * Author: Karim Bouanane
+ * Hardware: ATMEGA328P
+ */
+
+#ifndef SWUART_H_
+#define SWUART_H_
+
+#include <avr/io.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <string.h>
+#include <avr/interrupt.h>
+#include "ringbuffer.h"
+#include "serialstream.h"
+
+
+#ifndef F_CPU
+	#define F_CPU 16000000UL
+#endif
+
+#define SWUART_MIN_BIT_CYCLES	250		// cpu cycles of a bit, the interrupt and the main loop share them
+#define SWUART_MAX_BAUD_ERROR	2		// %, the receiver samples the last bit within half a bit
+
+//This section computes the timer values for a baudrate. Timer0 counts at
+//F_CPU/8 when one and a half bit period fits in its 8 bits, F_CPU/64 else.
+typedef struct
+{
+	uint8_t clock;			//!< Clock select bits of the prescaler.
+	uint8_t waitOne;		//!< Compare value to wait one bit period.
+	uint8_t waitOneHalf;	//!< Compare value to wait one and a half bit period.
+	
+} SWUARTTiming;
+
+// ticks of count half bit periods, rounded
+constexpr uint32_t swuartTicks(uint32_t baud, uint16_t prescaler, uint8_t count)
+{
+	return (F_CPU * count / prescaler + baud) / (2 * baud);
+}
+
+constexpr uint16_t swuartPrescaler(uint32_t baud)
+{
+	return swuartTicks(baud, 8, 3) <= 256 ? 8 : 64;
+}
+
+constexpr uint32_t swuartBaudError(uint32_t baud, uint32_t bitCycles)
+{
+	return (bitCycles * baud > F_CPU ? bitCycles * baud - F_CPU : F_CPU - bitCycles * baud) * 100 / F_CPU;
+}
+
+constexpr bool swuartBaudSupported(uint32_t baud)
+{
+	return baud > 0 &&
+		   swuartTicks(baud, swuartPrescaler(baud), 3) <= 256 &&
+		   swuartTicks(baud, swuartPrescaler(baud), 2) * swuartPrescaler(baud) >= SWUART_MIN_BIT_CYCLES &&
+		   swuartBaudError(baud, swuartTicks(baud, swuartPrescaler(baud), 2) * swuartPrescaler(baud)) < SWUART_MAX_BAUD_ERROR;
+}
+
+// the compare match is reached one tick after the compare value in CTC mode
+constexpr SWUARTTiming swuartTiming(uint32_t baud)
+{
+	return SWUARTTiming{ (uint8_t)(swuartPrescaler(baud) == 8 ? _BV(CS01) : _BV(CS01) | _BV(CS00)),
+						 (uint8_t)(swuartTicks(baud, swuartPrescaler(baud), 2) - 1),
+						 (uint8_t)(swuartTicks(baud, swuartPrescaler(baud), 3) - 1) };
+}
+
+#define SWUART_CHECK_BAUD(baud)		static_assert(swuartBaudSupported(baud), "the software uart can't run at " #baud " baud")
+
+SWUART_CHECK_BAUD(4800);
+SWUART_CHECK_BAUD(9600);
+SWUART_CHECK_BAUD(19200);
+SWUART_CHECK_BAUD(38400);
+SWUART_CHECK_BAUD(57600);
+
+//Some IO, timer and interrupt specific defines.
+#define ENABLE_EXTERNAL0_INTERRUPT()	(EIMSK |= _BV(INT0))
+#define DISABLE_EXTERNAL0_INTERRUPT()	(EIMSK &= ~_BV(INT0))
+#define ENABLE_INT0_FALLINGEDGE()		(EICRA |= _BV(ISC01))
+#define CLEAR_INT0_INTERRUPT()			(EIFR |= _BV(INTF0))
+
+#define ENABLE_TIMER_INTERRUPT()		(TIMSK0 |= _BV(OCIE0A))
+#define DISABLE_TIMER_INTERRUPT()		(TIMSK0 &= ~_BV(OCIE0A))
+#define CLEAR_TIMER_INTERRUPT()			(TIFR0 |= _BV(OCF0A))
+#define RESET_TIMER_PRESCALAR()			(TCCR0B &= ~(_BV(CS02) | _BV(CS01) | _BV(CS00)))
+#define SET_TIMER_PRESCALAR(clock)		(TCCR0B |= (clock))
+
+#define TX_PIN				PORTD3	// Transmit data pin, could be any digital pin
+#define RX_PIN				PORTD2	// Receive data pin, must be INT0
+#define SET_TX_PIN()		(PORTD |= _BV(TX_PIN))
+#define CLEAR_TX_PIN()		(PORTD &= ~_BV(TX_PIN))
+#define GET_RX_PIN()		(PIND & _BV(RX_PIN))
+
+#ifndef SWUART_RX_BUFFER_SIZE
+	#define SWUART_RX_BUFFER_SIZE	64	// must be a power of two, long modem replies are drained at once
+#endif
+
+#ifndef SWUART_TX_BUFFER_SIZE
+	#define SWUART_TX_BUFFER_SIZE	32	// must be a power of two
+#endif
+
+extern RingBuffer<SWUART_RX_BUFFER_SIZE> swuartRxBuffer;	// filled by the timer interrupt
+
+
+class SWUART : public SerialStream<SWUART>
+{
+	
+public:	// public methods
+
+	// settings
+    void init(uint32_t baud = 9600);
+    bool setBaud(uint32_t baud);							// false if the rate can't be met, the previous one is kept
+	
+	// send data, the strings are sent by SerialStream
+    void send(char data);
+	void flush();											// wait till the last queued byte is sent
+	bool isSending();
+	void setTxCompleteCallback(void (*callback)(void));		// called from the interrupt when the queue is sent
+	
+	// read data, the strings and the matching are read by SerialStream
+	bool isAvailable();
+	inline bool tryRead(char *data) { return swuartRxBuffer.pop((uint8_t *)data); }
+	
+	// statistics
+	uint16_t getFramingErrorCount();
+	uint16_t getOverflowCount();
+};
+
 #endif /* SWUART_H_ */
\ No newline at end of file
@@ -1,54 +1,62 @@
-/*
- * uart.h
- * 
- * UART driver, blocking i/o with timeout
- *
- * Author: Karim Bouanane
- * Hardware : ATMEGA328P
- */
-
-#ifndef UART_H_
-#define UART_H_
-
-#include <avr/io.h>
-#include <stdbool.h>
-#include <stddef.h>
-#include <string.h>
-#include "Timer.h"
-
-#ifndef F_CPU
-	#define F_CPU 16000000UL
-#endif
-
-#define MAX_DELAY 0xFFFFFFFF
-
-class UART
-{
-	
-public:	// public methods 
-	
-	// settings
-	void setBaud(uint32_t baud);
-	void init(uint32_t baud = 9600);
-	
-	// send data
-	void send(char data);
-	void sendString(const char *message);
-	void sendBytes(const char* bytes, size_t len);
-	void sendString(const char *message, size_t len);
-	
-	// read data
-	void flush();
-	bool read(char *data, uint32_t timeout = MAX_DELAY);
-	size_t readString(char *buff, size_t len, uint32_t timeout = MAX_DELAY);
-	size_t readBytes(char *buff, size_t len, uint32_t timeout = MAX_DELAY);
-	size_t readStringUntil(char terminator, char *buff, size_t len, uint32_t timeout = MAX_DELAY);
-	
-	// find data
-	bool find(const char *target, uint32_t timeout = MAX_DELAY);
-	bool find(const char *target, size_t len, uint32_t timeout = MAX_DELAY);
-	uint8_t findOneOf(const char *target1, const char *target2, uint32_t timeout = MAX_DELAY);
-	uint8_t findOneOf(const char *target1, size_t len1, const char *target2, size_t len2, uint32_t timeout = MAX_DELAY);
-};
-
-#endif /* UART_H_ */
+/*
+ * uart.h
+ * 
+ * UART driver, interrupt driven reception and transmission through
+ * ring buffers, blocking i/o with timeout
+ *
+ * Author: Karim Bouanane
+ * Hardware : ATMEGA328P
+ */
+
+#ifndef UART_H_
+#define UART_H_
+
+#include <avr/io.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+#include <avr/interrupt.h>
+#include "ringbuffer.h"
+#include "serialstream.h"
+
+#ifndef F_CPU
+	#define F_CPU 16000000UL
+#endif
+
+#ifndef UART_RX_BUFFER_SIZE
+	#define UART_RX_BUFFER_SIZE	64	// must be a power of two, holds ~64 ms of data at 9600 bauds
+#endif
+
+#ifndef UART_TX_BUFFER_SIZE
+	#define UART_TX_BUFFER_SIZE	32	// must be a power of two
+#endif
+
+extern RingBuffer<UART_RX_BUFFER_SIZE> uartRxBuffer;	// filled by the receive interrupt
+
+
+class UART : public SerialStream<UART>
+{
+	
+public:	// public methods 
+	
+	// settings
+	void setBaud(uint32_t baud);
+	void init(uint32_t baud = 9600);
+	
+	// send data, the strings are sent by SerialStream
+	void send(char data);
+	void flush();											// wait till the last queued byte left the shift register
+	bool isSending();
+	void setTxCompleteCallback(void (*callback)(void));		// called from the interrupt when the queue is sent
+	
+	// read data, the strings and the matching are read by SerialStream
+	bool isAvailable();
+	inline bool tryRead(char *data) { return uartRxBuffer.pop((uint8_t *)data); }
+	
+	// statistics
+	uint16_t getOverrunCount();
+	uint16_t getFramingErrorCount();
+	uint16_t getOverflowCount();
+};
+
+#endif /* UART_H_ */
@@ -0,0 +1,109 @@
+/*
+ * matcher.cpp
+ *
+ * Streaming matcher that watches several patterns at once in a single pass
+ * over the received bytes, one KMP automaton per pattern
+ *
+ * Author: Karim Bouanane
+ * Hardware: ATMEGA328P
+ */
+
+#include "matcher.h"
+
+
+StreamMatcher::StreamMatcher(MatcherPattern *slots, uint8_t capacity)
+	: slots(slots)
+	, capacity(capacity)
+	, count(0)
+{
+}
+
+
+/**** Patterns ****/
+
+bool StreamMatcher::add(const char *target)
+{
+	return add(target, strlen(target));
+}
+
+bool StreamMatcher::add(const char *target, size_t len)
+{
+	if (count >= capacity || len == 0 || len > MATCHER_MAX_LENGTH)
+		return false;
+
+	uint8_t *fail = slots[count].failure;
+	uint8_t k = 0;
+
+	// build the failure table of the pattern
+	fail[0] = 0;
+
+	for (uint8_t i = 1; i < len; i++)
+	{
+		while (k > 0 && target[i] != target[k])
+			k = fail[k - 1];
+
+		if (target[i] == target[k])
+			k++;
+
+		fail[i] = k;
+	}
+
+	slots[count].pattern = target;
+	slots[count].length = len;
+	slots[count].matched = 0;
+	count++;
+
+	return true;
+}
+
+void StreamMatcher::clear()
+{
+	count = 0;
+}
+
+uint8_t StreamMatcher::getCount()
+{
+	return count;
+}
+
+
+/**** Matching ****/
+
+void StreamMatcher::reset()
+{
+	for (uint8_t i = 0; i < count; i++)
+		slots[i].matched = 0;
+}
+
+// advance every automaton by one byte, return the number (starting at 1) of the
+// completed pattern or MATCHER_NO_MATCH. If several patterns end on the same
+// byte, the one added first wins
+uint8_t StreamMatcher::feed(char data)
+{
+	uint8_t found = MATCHER_NO_MATCH;
+
+	for (uint8_t i = 0; i < count; i++)
+	{
+		MatcherPattern *slot = &slots[i];
+		const char *target = slot->pattern;
+		uint8_t q = slot->matched;
+
+		while (q > 0 && target[q] != data)
+			q = slot->failure[q - 1];		// fall back to the longest prefix still matching
+
+		if (target[q] == data)
+			q++;
+
+		if (q == slot->length)
+		{
+			if (found == MATCHER_NO_MATCH)
+				found = i + 1;
+
+			q = slot->failure[q - 1];		// keep overlapping matches possible
+		}
+
+		slot->matched = q;
+	}
+
+	return found;
+}
@@ -1,135 +1,749 @@
-/*
- * main.cpp
- *
- * 
- * Author : Karim Bouanane
- */
-
-#ifndef F_CPU
-	#define F_CPU 16000000UL
-#endif
-
-#include <avr/io.h>
-#include <stdlib.h>
-#include <util/delay.h>
-#include "ErrorHandler.h"
-#include "UBXGPS.h"
-#include "GPRS.h"
-
-
-/** Definitions **/
-
-#define SERVER_URL		"https://karim-gps.glitch.me/updateLoc"
-#define CONTENT_TYPE	"application/x-www-form-urlencoded"
-#define APN_ORANGE		"internet.orange.ma"
-#define APN_IAM			"www.iamgrps1.ma"
-
-#define GPS_GPRS_DISCONNECTED	1
-
-
-// Debugging function
-
-inline void DebugPulse(uint8_t count)
-{
-	while (count--)
-	{
-		PORTD |= _BV(7);
-		PORTD &= ~_BV(7);
-	}
-}
-
-
-UBXGPS gps;
-GPRS gprs;
-
-char httpData[30];
-
-int main()
-{
-	//DDRD |= _BV(7);	// this pin is used by the logic analyzer device for debugging 
-	
-	// Initialize serial communication
-	
-	gps.initSerial();
-	gprs.initSerial();
-	
-	
-	// Verify module connection
-	
-	uint8_t httpStatus;
-	uint8_t gprsStatus;
-	uint8_t gpsStatus;
-	
-	gprsStatus = gprs.isConnected();			
-	gpsStatus = gps.isConnected();
-	
-	if(gprsStatus == GPRS_DISCONNECTED && gpsStatus == GPS_DISCONNECTED)
-	{
-		errorHandler(BOTH_MODULE, GPS_GPRS_DISCONNECTED);
-	}
-	else if(gpsStatus == GPS_DISCONNECTED)
-	{
-		errorHandler(GPS_MODULE, GPS_DISCONNECTED);
-	}
-	else if(gprsStatus == GPRS_DISCONNECTED)
-	{
-		errorHandler(GPRS_MODULE, GPRS_DISCONNECTED);
-	}	
-	
-	
-	// Wait gprs module to be ready
-	
-	gprsStatus = gprs.waitReady();
-	
-	if(gprsStatus != GPRS_SUCCESS_REPLY )
-	{
-		errorHandler(GPRS_MODULE, gprsStatus);
-	}
-	
-	
-	// Initialize module
-	
-	gprsStatus = gprs.activateGPRS(APN_IAM);
-	
-	if(gprsStatus != GPRS_SUCCESS_REPLY)			// connect to the internet
-	{
-		errorHandler(GPRS_MODULE, gprsStatus);
-	}
-	
-	
-	// GPS is already configure by u-center software to generate these messages
-	
-	// gps.enableMessage(NAV_STATUS);
-	// gps.enableMessage(NAV_POSLLH);
-	
-	
-	// Loop
-	
-	while(1)
-	{
-		// Acquire Location
-		
-		gpsStatus = gps.waitValidLocation();
-		
-		if (gpsStatus != LOCATION_FOUND)
-		{
-			errorHandler(GPS_MODULE, gpsStatus);
-		}
-		
-		// Construct URL Request
-		
-		strcpy(httpData, "lat=");
-		strcat(httpData, gps.getStrLatitude());
-		strcat(httpData, "&lng=");
-		strcat(httpData, gps.getStrLongitude());
-		
-		// Send HTTP Post Request to server
-		
-		httpStatus = gprs.send_HTTP_POSTRequest(SERVER_URL, CONTENT_TYPE, httpData, 5);
-		
-		if(httpStatus != GPRS_SUCCESS_REPLY)
-			errorHandler(GPRS_MODULE, httpStatus);
-		
-	}
-	
+/*
+ * main.cpp
+ *
+ * 
+ * Author : Karim Bouanane
+ */
+
+#ifndef F_CPU
+	#define F_CPU 16000000UL
+#endif
+
+#include <avr/io.h>
+#include <avr/pgmspace.h>
+#include <stdlib.h>
+#include <string.h>
+#include <util/delay.h>
+#include "ErrorHandler.h"
+#include "UBXGPS.h"
+#include "GPRS.h"
+#include "Scheduler.h"
+#include "FixQueue.h"
+#include "UDPWindow.h"
+#include "FixLog.h"
+#include "FixCodec.h"
+#include "ReportPolicy.h"
+#include "TrackSimplifier.h"
+#include "KalmanFilter.h"
+#include "Geofence.h"
+#include "PowerManager.h"
+
+
+/** Definitions **/
+
+#define SERVER_URL		"https://karim-gps.glitch.me/updateLoc"
+#define SERVER_HOST		"karim-gps.glitch.me"
+#define SERVER_PORT		"80"
+#define SERVER_PATH		"/updateLoc"
+#define CONTENT_TYPE	"application/x-www-form-urlencoded"
+#define APN_ORANGE		"internet.orange.ma"
+#define APN_IAM			"www.iamgrps1.ma"
+
+#define GPS_GPRS_DISCONNECTED	1
+
+#define REPORT_INTERVAL			1000	// ms between two checks of the reported fixes
+#define REPORT_BATCH_SIZE		4		// fixes sent in one request
+#define REPORT_MAX_AGE			60000	// ms a fix can wait for its batch to be complete
+#define HTTP_DATA_SIZE			64		// room for REPORT_BATCH_SIZE encoded fixes on a typical track
+#define GPS_SILENCE_TIMEOUT		20000	// ms without any GPS message before checking the module
+#define RECONNECT_INTERVAL		30000	// ms between a failure and the next GPRS activation
+#define DRAIN_INTERVAL			1000	// ms between two checks of the EEPROM log
+#define TRACK_TOLERANCE			10		// m between a dropped fix and the uploaded track, at most
+#define TRACK_MAX_HOLD			60000	// ms a fix can be held by the simplifier
+
+#define ALERT_SMS				1		// send an SMS on each geofence transition
+#define ALERT_PHONE				"+212600000000"
+#define ALERT_SIZE				32		// room for the SMS text
+
+#define POWER_SAVING			1		// sleep between the reports while parked
+#define PARKED_DELAY			120000	// ms without movement before the first sleep
+#define SLEEP_TIME				60000	// ms slept each time
+#define AWAKE_TIME				30000	// ms awake after a sleep waiting for a fix, at most
+#define GPS_POWER_SAVE			0		// cyclic tracking of the GPS between the fixes
+#define GPS_UPDATE_PERIOD		1000	// ms between two fixes in cyclic tracking
+#define GPS_SEARCH_PERIOD		10000	// ms between two searches when the signal is lost
+#define POWER_INTERVAL			1000	// ms between two checks of the sleep conditions
+
+// the socket transports are plain text, only TRANSPORT_HTTP goes through https
+#define TRANSPORT_HTTP			0		// AT+HTTPPOST for each request
+#define TRANSPORT_TCP			1		// keep-alive socket with pipelined requests
+#define TRANSPORT_UDP			2		// one datagram per fix, selectively acknowledged
+#define REPORT_TRANSPORT		TRANSPORT_HTTP
+
+#define MAX_PIPELINED			2		// requests sent and waiting for their response
+#define DEVICE_ID				"1"		// identifies the tracker in the datagrams
+#define UDP_SERVER_PORT			"5005"
+#define UDP_RETRY_TIMEOUT		5000	// ms without acknowledgment before a datagram is sent again
+
+
+// Debugging function
+
+inline void DebugPulse(uint8_t count)
+{
+	while (count--)
+	{
+		PORTD |= _BV(7);
+		PORTD &= ~_BV(7);
+	}
+}
+
+
+/** Geofence zones, example coordinates **/
+
+constexpr GeoPoint depotVertices[] PROGMEM =
+{
+	{ 335731000, -76120000 },
+	{ 335738000, -76098000 },
+	{ 335719000, -76091000 },
+	{ 335712000, -76113000 }
+};
+
+const char depotName[] PROGMEM = "depot";
+const char homeName[] PROGMEM = "home";
+
+constexpr GeoZone zones[] PROGMEM =
+{
+	GEO_POLYGON(depotVertices, depotName),
+	geoCircle(335890000, -75990000, 300, homeName)
+};
+
+
+UBXGPS gps;
+GPRS gprs;
+Scheduler scheduler;
+FixQueue fixQueue(REPORT_BATCH_SIZE, REPORT_MAX_AGE);
+FixLog fixLog;
+ReportPolicy reportPolicy;
+KalmanFilter positionFilter;
+Geofence geofence(zones, sizeof(zones) / sizeof(GeoZone));
+PowerManager power(&gprs, &gps);
+TrackSimplifier simplifier(TRACK_TOLERANCE, TRACK_MAX_HOLD);
+
+#if REPORT_TRANSPORT == TRANSPORT_UDP
+UDPWindow udpWindow(UDP_RETRY_TIMEOUT);
+#endif
+
+char httpData[HTTP_DATA_SIZE];
+
+
+/** Tasks **/
+
+typedef enum
+{
+	JOB_NONE = 0,
+	JOB_CONNECT,		// GPRS activation queued
+	JOB_OPEN,			// socket opening queued
+	JOB_REPORT,			// HTTP POST or datagram queued
+	JOB_SMS				// geofence alert queued
+	
+} ModemJob;
+
+// request sent and waiting for its acknowledgment
+typedef struct
+{
+	uint8_t fixes;			// fixes carried by the request
+	bool fromLog;			// the fixes come from the EEPROM log, not from the queue
+	
+} Request;
+
+static ModemJob modemJob = JOB_NONE;
+static bool internetReady = false;
+static uint32_t offlineTime;		// last time the connection was lost
+
+static bool urgentReport = false;	// a geofence transition is sent without waiting for the batch
+static uint8_t alertEntered;		// zones entered, SMS not sent yet
+static uint8_t alertLeft;			// zones left, SMS not sent yet
+static char alertText[ALERT_SIZE];
+static Request pending[MAX_PIPELINED];	// oldest first
+static uint8_t pendingCount;
+static uint32_t gpsCheckTime;		// last time the silent GPS module was checked
+static uint32_t lastMoveTime;		// last fix showing the vehicle moving
+static uint32_t wakeupTime;			// end of the last sleep
+
+
+// add a fix to the upload queue, or to the UDP window
+static void queueFix(const Fix& fix)
+{
+#if REPORT_TRANSPORT == TRANSPORT_UDP
+	
+	// each fix is a datagram of its own, sent by the modem task. Offline,
+	// it waits in the EEPROM instead
+	
+	if (internetReady == true || fixLog.push(fix) == false)
+		udpWindow.push(fix);
+	
+#else
+	
+	// a full queue drops its oldest fix, which belongs to the oldest request
+	// of the queue still in flight, if any. The log requests come in between
+	if (fixQueue.getCount() == FIX_QUEUE_SIZE)
+	{
+		for (uint8_t i = 0; i < pendingCount; i++)
+		{
+			if (pending[i].fromLog == false && pending[i].fixes > 0)
+			{
+				pending[i].fixes--;
+				break;
+			}
+		}
+	}
+	
+	fixQueue.push(fix, timerNow());
+	
+#endif
+}
+
+
+// parse the GPS bytes received since the last tick
+static void gpsTask()
+{
+	NavSolution smoothed;
+	Fix fix;
+	Fix kept;
+	uint8_t transitions;
+	
+	// the filter smooths the jitter and drops the multipath jumps, the policy
+	// keeps the fixes that tell something new, by distance, heading or age,
+	// then the simplifier drops those the track can do without
+	
+	if (gps.update())
+	{
+		if (positionFilter.update(gps.getNavSolution()) == false)
+			return;
+		
+		smoothed = *gps.getNavSolution();
+		smoothed.latitude = positionFilter.getLatitude();
+		smoothed.longitude = positionFilter.getLongitude();
+		smoothed.velN = positionFilter.getVelocityNorth();
+		smoothed.velE = positionFilter.getVelocityEast();
+		smoothed.gSpeed = positionFilter.getSpeed();
+		
+		if (reportPolicy.isMoving(&smoothed))
+			lastMoveTime = timerNow();
+		
+		fix.time = gps.getUnixTime();
+		fix.latitude = smoothed.latitude;
+		fix.longitude = smoothed.longitude;
+		
+		// a geofence transition is sent at once with the track leading to it,
+		// whatever the policy and the batch
+		
+		transitions = geofence.update(fix.latitude, fix.longitude);
+		
+		if (transitions != 0)
+		{
+			alertEntered |= transitions & geofence.getInside();
+			alertLeft |= transitions & ~geofence.getInside();
+			
+#if REPORT_TRANSPORT != TRANSPORT_UDP
+			urgentReport = true;		// a datagram leaves at once anyway
+#endif
+			
+			if (simplifier.flush(&kept))
+				queueFix(kept);
+			
+			simplifier.reset();
+			simplifier.push(fix, timerNow(), &kept);
+			queueFix(fix);
+			return;
+		}
+		
+		if (reportPolicy.shouldReport(&smoothed, timerNow()) == false)
+			return;
+		
+		if (simplifier.push(fix, timerNow(), &kept))
+			queueFix(kept);
+	}
+	else if (timerNow() - gps.getLastMessageTime() > GPS_SILENCE_TIMEOUT &&
+			 timerNow() - gpsCheckTime > GPS_SILENCE_TIMEOUT)					// gps module not sending any messages
+	{
+		gpsCheckTime = timerNow();
+		
+		if(gps.isConnected() != GPS_SUCCESS_REPLY)		// check module connection
+		{
+			errorHandler(GPS_MODULE, GPS_DISCONNECTED);
+		}
+		else if (gps.reset() != GPS_SUCCESS_REPLY)		// try restarting the module
+		{
+			errorHandler(GPS_MODULE, GPS_RESTART_FAIL);
+		}
+	}
+}
+
+
+// number of fixes of the queue, or of the log, already sent and waiting for their acknowledgment
+static uint8_t pendingFixes(bool fromLog)
+{
+	uint8_t fixes = 0;
+	
+	for (uint8_t i = 0; i < pendingCount; i++)
+	{
+		if (pending[i].fromLog == fromLog)
+			fixes += pending[i].fixes;
+	}
+	
+	return fixes;
+}
+
+
+// the oldest request reached the server, its fixes leave the queue or the log
+static void acknowledgeRequest()
+{
+	if (pending[0].fromLog)
+		fixLog.markSent(pending[0].fixes);
+	else
+		fixQueue.pop(pending[0].fixes);
+	
+	for (uint8_t i = 1; i < pendingCount; i++)
+		pending[i - 1] = pending[i];
+	
+	pendingCount--;
+}
+
+
+// keep the queued fixes in the EEPROM while the server can't be reached
+static void spillQueue()
+{
+	while (fixQueue.getCount() > 0 && fixLog.push(*fixQueue.peek(0)))
+		fixQueue.pop(1);
+	
+	// the fixes of a geofence transition wait in the log too, they are
+	// sent first by the drain once online
+	if (fixQueue.getCount() == 0)
+		urgentReport = false;
+}
+
+
+// a report failed or the network is lost, the fixes wait in the EEPROM and
+// the GPRS activation is queued again after RECONNECT_INTERVAL
+static void goOffline()
+{
+	gprs.abortQueue();
+	
+#if REPORT_TRANSPORT != TRANSPORT_HTTP
+	gprs.beginSocketClose();
+#endif
+	
+	internetReady = false;
+	modemJob = JOB_NONE;
+	pendingCount = 0;
+	offlineTime = timerNow();
+	
+#if REPORT_TRANSPORT != TRANSPORT_UDP
+	spillQueue();
+#endif
+}
+
+
+// send httpData holding the given fixes, the connection is opened first when needed.
+// Return false if the request is not queued yet
+static bool sendBatch(uint8_t fixes, bool fromLog)
+{
+	if (fixes == 0)
+		return false;
+	
+#if REPORT_TRANSPORT == TRANSPORT_TCP
+	
+	// the connection is opened once and kept, the batch waits for it
+	
+	if (gprs.isTCPConnected() == false)
+	{
+		if (gprs.beginTCPConnect(SERVER_HOST, SERVER_PORT))
+			modemJob = JOB_OPEN;
+		
+		return false;
+	}
+	
+	if (gprs.beginTCPPOST(SERVER_HOST, SERVER_PATH, CONTENT_TYPE, httpData) == false)
+		return false;
+	
+#else
+	
+	if (gprs.beginHTTPPOST(SERVER_URL, CONTENT_TYPE, httpData, 5) == false)
+		return false;
+	
+#endif
+	
+	pending[pendingCount].fixes = fixes;
+	pending[pendingCount].fromLog = fromLog;
+	pendingCount++;
+	modemJob = JOB_REPORT;
+	
+	return true;
+}
+
+
+#if REPORT_TRANSPORT == TRANSPORT_UDP
+
+// send the next datagram due, new or lost, the window keeps it till it is acknowledged
+static void sendDatagram()
+{
+	const Datagram* datagram;
+	
+	if (internetReady == false || udpWindow.getCount() == 0)
+		return;
+	
+	if (gprs.isUDPOpen() == false)
+	{
+		if (gprs.beginUDPOpen(SERVER_HOST, UDP_SERVER_PORT))
+			modemJob = JOB_OPEN;
+		
+		return;
+	}
+	
+	datagram = udpWindow.next(timerNow());
+	
+	if (datagram == NULL || udpWindow.format(datagram, DEVICE_ID, httpData, sizeof(httpData)) == 0)
+		return;
+	
+	if (gprs.beginUDPSend(httpData))
+		modemJob = JOB_REPORT;
+}
+
+#endif
+
+
+#if ALERT_SMS
+
+// send the SMS of a geofence transition, one at a time between the reports
+static bool sendAlert()
+{
+	uint8_t zone = 0;
+	bool entered;
+	size_t length;
+	
+	if ((alertEntered | alertLeft) == 0)
+		return false;
+	
+	while (((alertEntered | alertLeft) & _BV(zone)) == 0)
+		zone++;
+	
+	entered = alertEntered & _BV(zone);
+	
+	strcpy(alertText, entered ? "Entered " : "Left ");
+	length = strlen(alertText);
+	geofence.getName(zone, alertText + length, sizeof(alertText) - length);
+	
+	if (gprs.beginSMS(ALERT_PHONE, alertText) == false)
+		return false;
+	
+	if (entered)
+		alertEntered &= ~_BV(zone);
+	else
+		alertLeft &= ~_BV(zone);
+	
+	modemJob = JOB_SMS;
+	return true;
+}
+
+#endif
+
+
+// advance the queued AT commands and check the result of the current job
+static void modemTask()
+{
+	uint8_t gprsStatus = gprs.poll();
+	
+#if REPORT_TRANSPORT == TRANSPORT_TCP
+	
+	uint8_t httpStatus;
+	
+	// responses come back in the order of the requests
+	while (pendingCount > 0 && gprs.getTCPResponse(&httpStatus))
+	{
+		if (httpStatus != GPRS_SUCCESS_REPLY)
+		{
+			goOffline();
+			return;
+		}
+		
+		acknowledgeRequest();
+	}
+	
+	// the responses of a closed socket are lost, their fixes are sent again
+	if (gprs.isTCPConnected() == false && modemJob != JOB_REPORT)
+		pendingCount = 0;
+	
+#elif REPORT_TRANSPORT == TRANSPORT_UDP
+	
+	uint16_t ackSeq;
+	uint32_t ackBitmap;
+	
+	if (gprs.getUDPAck(&ackSeq, &ackBitmap))
+		udpWindow.acknowledge(ackSeq, ackBitmap);
+	
+#endif
+	
+	if (gprsStatus == GPRS_BUSY)
+		return;
+	
+	if (modemJob == JOB_NONE)
+	{
+#if ALERT_SMS
+		if (sendAlert())
+			return;
+#endif
+		
+		// activate the connection again after a failure
+		if (internetReady == false)
+		{
+			if (timerNow() - offlineTime >= RECONNECT_INTERVAL && gprs.beginActivateGPRS(APN_IAM))
+				modemJob = JOB_CONNECT;
+		}
+#if REPORT_TRANSPORT == TRANSPORT_UDP
+		else
+		{
+			sendDatagram();
+		}
+#endif
+		return;
+	}
+	
+	// the SMS doesn't use the data connection, a failed one is dropped, the
+	// report of the transition is still sent
+	if (modemJob == JOB_SMS)
+	{
+		modemJob = JOB_NONE;
+		return;
+	}
+	
+	// nothing is lost on a failure, the fixes wait till the connection is back
+	if (gprsStatus != GPRS_SUCCESS_REPLY)
+	{
+		goOffline();
+		return;
+	}
+	
+	if (modemJob == JOB_CONNECT)
+		internetReady = true;
+	else if (modemJob == JOB_REPORT && REPORT_TRANSPORT == TRANSPORT_HTTP)
+		acknowledgeRequest();			// the batch reached the server
+	
+	modemJob = JOB_NONE;
+}
+
+
+// queue the fix held too long by the simplifier, and send the queued fixes
+// in one request once the batch is ready
+static void reportTask()
+{
+	uint8_t included;
+	Fix kept;
+	
+	if (simplifier.poll(timerNow(), &kept))
+		queueFix(kept);
+	
+#if REPORT_TRANSPORT == TRANSPORT_UDP
+	
+	// the datagrams are sent by the modem task
+	
+	return;
+	
+#endif
+	
+	if (internetReady == false)
+	{
+		spillQueue();
+		return;
+	}
+	
+	if (modemJob != JOB_NONE || pendingCount >= MAX_PIPELINED)
+		return;
+	
+	if (fixQueue.isReady(timerNow(), pendingFixes(false)) == false && urgentReport == false)
+		return;
+	
+	// Construct the request body, httpData is kept till the end of the job
+	
+	fixQueue.format(httpData, sizeof(httpData), &included, pendingFixes(false));
+	
+	// Send HTTP Post Request to server, a geofence transition is urgent till
+	// its request is queued, or already in flight when nothing is left
+	
+	if (sendBatch(included, false) || included == 0)
+		urgentReport = false;
+}
+
+
+// upload the fixes kept in the EEPROM once the connection is back, a batch
+// at a time between the live reports
+static void drainTask()
+{
+	Fix fixes[REPORT_BATCH_SIZE];
+	
+	if (internetReady == false || fixLog.getCount() == 0)
+		return;
+	
+#if REPORT_TRANSPORT == TRANSPORT_UDP
+	
+	// the window takes them like new fixes, they leave the log once in RAM
+	
+	if (udpWindow.getCount() < UDP_WINDOW_SIZE / 2 && fixLog.read(fixes, 1) == 1)
+	{
+		udpWindow.push(fixes[0]);
+		fixLog.markSent(1);
+	}
+	
+#else
+	
+	FixEncoder encoder;
+	uint8_t count;
+	uint8_t included = 0;
+	
+	if (modemJob != JOB_NONE || pendingCount >= MAX_PIPELINED)
+		return;
+	
+	count = fixLog.read(fixes, REPORT_BATCH_SIZE, pendingFixes(true));
+	
+	encoder.begin(httpData, sizeof(httpData));
+	
+	while (included < count && encoder.add(fixes[included]))
+		included++;
+	
+	encoder.end();
+	
+	sendBatch(included, true);
+	
+#endif
+}
+
+
+#if POWER_SAVING
+
+// nothing is waiting to be sent, or it can't be sent anyway
+static bool isIdle()
+{
+	if (modemJob != JOB_NONE || gprs.isBusy() || pendingCount > 0 ||
+		fixLog.isWriting() || (alertEntered | alertLeft) != 0)
+		return false;
+	
+	if (internetReady == false)
+		return true;
+	
+	if (urgentReport)
+		return false;
+	
+#if REPORT_TRANSPORT == TRANSPORT_UDP
+	if (udpWindow.getCount() > 0)
+		return false;
+#endif
+	
+	return fixQueue.getCount() == 0 && fixLog.getCount() == 0;
+}
+
+
+// sleep while parked once the reports are sent. After each sleep the GPS
+// gets a fix first, AWAKE_TIME at most, and the tracker moves on if the
+// vehicle moved meanwhile
+static void powerTask()
+{
+	if (timerNow() - lastMoveTime < PARKED_DELAY || isIdle() == false ||
+		(gps.isWaitingFix() && timerNow() - wakeupTime < AWAKE_TIME))
+		return;
+	
+	power.sleep(SLEEP_TIME);
+	
+	// the GPS messages are late because of the sleep, not because of the module
+	wakeupTime = timerNow();
+	gpsCheckTime = wakeupTime;
+}
+
+#endif
+
+
+int main()
+{
+	//DDRD |= _BV(7);	// this pin is used by the logic analyzer device for debugging 
+	
+	// Initialize serial communication
+	
+	gps.initSerial();
+	gprs.initSerial();
+	
+	
+	// Stop the unused peripherals
+	
+	power.begin();
+	
+	
+	// Find the fixes left in the EEPROM by the previous run
+	
+	fixLog.begin();
+	
+#if REPORT_TRANSPORT == TRANSPORT_UDP
+	udpWindow.setSession(fixLog.getBootCount());	// the server starts the sequence numbers again
+#endif
+	
+	
+	// Verify module connection
+	
+	uint8_t gprsStatus;
+	uint8_t gpsStatus;
+	
+	gprsStatus = gprs.isConnected();			
+	gpsStatus = gps.isConnected();
+	
+	if(gprsStatus == GPRS_DISCONNECTED && gpsStatus == GPS_DISCONNECTED)
+	{
+		errorHandler(BOTH_MODULE, GPS_GPRS_DISCONNECTED);
+	}
+	else if(gpsStatus == GPS_DISCONNECTED)
+	{
+		errorHandler(GPS_MODULE, GPS_DISCONNECTED);
+	}
+	else if(gprsStatus == GPRS_DISCONNECTED)
+	{
+		errorHandler(GPRS_MODULE, GPRS_DISCONNECTED);
+	}	
+	
+	
+	// Wait gprs module to be ready
+	
+	gprsStatus = gprs.waitReady();
+	
+	// out of coverage is not fatal, the fixes wait in the EEPROM till the registration
+	if(gprsStatus != GPRS_SUCCESS_REPLY && gprsStatus != GSM_REGISTERATION_FAIL)
+	{
+		errorHandler(GPRS_MODULE, gprsStatus);
+	}
+	
+	
+	// NAV_PVT gives the whole fix in one message, the NAV_STATUS and NAV_POSLLH
+	// pair configured by u-center software is kept if it can't be enabled
+	
+	if (gps.enableMessage(NAV_PVT) == true)
+	{
+		gps.disableMessage(NAV_STATUS);
+		gps.disableMessage(NAV_POSLLH);
+	}
+	
+#if GPS_POWER_SAVE
+	gps.setPowerSave(GPS_UPDATE_PERIOD, GPS_SEARCH_PERIOD, 0);
+#endif
+	
+	
+	// Connect to the internet, the GPS keeps being parsed meanwhile
+	
+	gprs.beginActivateGPRS(APN_IAM);
+	modemJob = JOB_CONNECT;
+	
+	
+	// Loop
+	
+	gpsCheckTime = timerNow();
+	
+	scheduler.addTask(gpsTask, 0);
+	scheduler.addTask(modemTask, 0);
+	scheduler.addTask(reportTask, REPORT_INTERVAL);
+	scheduler.addTask(drainTask, DRAIN_INTERVAL);
+	
+#if POWER_SAVING
+	scheduler.addTask(powerTask, POWER_INTERVAL);
+#endif
+	
+	while(1)
+	{
+		scheduler.tick();
+	}
+	
 }
\ No newline at end of file
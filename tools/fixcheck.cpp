@@ -0,0 +1,310 @@
+/*
+ * fixcheck.cpp
+ *
+ * Host side check of FixCodec.cpp. Each batch is written by FixEncoder,
+ * read back by FixDecoder and compared fix by fix, in particular :
+ *
+ *		- the zig-zag of negative deltas, time going back included
+ *		- the varint boundaries, a delta one step each side of 7, 14, 21
+ *		  and 28 bits, the length of the body is checked too
+ *		- the base64url end of a batch of 3n, 3n+1 and 3n+2 bytes, the
+ *		  last bits are padded with 0 and no '=' is written
+ *		- the jumps across the antimeridian and the extreme coordinates
+ *		- a full buffer, the fixes written before it still decode
+ *		- the malformed bodies, which the decoder must reject
+ *
+ * A line is printed for each case, the exit status is 1 if one of them fails.
+ *
+ * Build :	g++ -I../Lib/Header -o fixcheck fixcheck.cpp ../Lib/Src/FixCodec.cpp
+ *
+ * Author: Karim Bouanane
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdint.h>
+#include "FixCodec.h"
+
+#define BODY_SIZE		512
+#define MAX_FIXES		32
+#define PREFIX_LENGTH	(sizeof(FIX_CODEC_FIELD) - 1)
+
+static long errors;
+
+
+static bool report(const char* name, long before)
+{
+	bool ok = errors == before;
+
+	printf("%s %s\n", ok ? "ok  " : "FAIL", name);
+
+	return ok;
+}
+
+
+static void fail(const char* what, const char* body)
+{
+	if (errors++ < 20)
+		printf("  %s : %s\n", what, body);
+}
+
+
+static bool sameFix(const Fix& a, const Fix& b)
+{
+	return a.time == b.time && a.latitude == b.latitude && a.longitude == b.longitude;
+}
+
+
+// fix from a time and coordinates given as 32 bit patterns, as the tracker stores them
+static Fix makeFix(uint32_t time, uint32_t latitude, uint32_t longitude)
+{
+	Fix fix;
+
+	fix.time = time;
+	fix.latitude = (int32_t)latitude;
+	fix.longitude = (int32_t)longitude;
+
+	return fix;
+}
+
+
+// bytes of a varint holding the zig-zag of a delta
+static uint8_t varintLength(int32_t delta)
+{
+	uint32_t value = delta < 0 ? ~((uint32_t)delta << 1) : (uint32_t)delta << 1;
+	uint8_t length = 1;
+
+	while (value >= 0x80)
+	{
+		value >>= 7;
+		length++;
+	}
+
+	return length;
+}
+
+
+// characters of a body of n bytes, the last character holds the padded bits
+static size_t bodyLength(size_t bytes)
+{
+	return PREFIX_LENGTH + (8 * bytes + 5) / 6;
+}
+
+
+// decode the body and compare it with the fixes, return false on a difference
+static bool decodeAndCompare(const char* body, const Fix* fixes, uint8_t count)
+{
+	FixDecoder decoder;
+	Fix fix;
+	uint8_t decoded = 0;
+
+	if (decoder.begin(body) == false)
+	{
+		fail("header rejected", body);
+		return false;
+	}
+
+	while (decoder.next(&fix))
+	{
+		if (decoded >= count || sameFix(fix, fixes[decoded]) == false)
+		{
+			fail("fix differs", body);
+			return false;
+		}
+
+		decoded++;
+	}
+
+	if (decoder.isValid() == false || decoded != count)
+	{
+		fail(decoder.isValid() ? "fixes missing" : "body rejected", body);
+		return false;
+	}
+
+	return true;
+}
+
+
+// write the batch, check the body against the expected text or length, decode it back
+static bool roundTrip(const Fix* fixes, uint8_t count, const char* expected, size_t length)
+{
+	FixEncoder encoder;
+	char body[BODY_SIZE];
+
+	encoder.begin(body, sizeof(body));
+
+	for (uint8_t i = 0; i < count; i++)
+	{
+		if (encoder.add(fixes[i]) == false)
+		{
+			fail("fix refused", body);
+			return false;
+		}
+	}
+
+	encoder.end();
+
+	if (strchr(body, '=') != body + PREFIX_LENGTH - 1)
+		fail("padding written", body);
+	else if (expected != NULL && strcmp(body, expected) != 0)
+		fail("body differs", body);
+	else if (length != 0 && strlen(body) != length)
+		fail("length differs", body);
+	else
+		return decodeAndCompare(body, fixes, count);
+
+	return false;
+}
+
+
+// a fix moved by the same delta on the three fields, in a batch of its own
+static bool deltaTrip(int32_t delta)
+{
+	Fix fix = makeFix((uint32_t)delta, (uint32_t)delta, (uint32_t)delta);
+
+	return roundTrip(&fix, 1, NULL, bodyLength(1 + 3 * varintLength(delta)));
+}
+
+
+static bool rejected(const char* body)
+{
+	FixDecoder decoder;
+	Fix fix;
+
+	if (decoder.begin(body))
+	{
+		while (decoder.next(&fix));
+	}
+
+	if (decoder.isValid())
+	{
+		fail("accepted", body);
+		return false;
+	}
+
+	return true;
+}
+
+
+int main()
+{
+	bool ok = true;
+	long before;
+
+	// byte 0 is the version alone : 00000001 -> "A" "Q" with 4 bits of padding
+	before = errors;
+	roundTrip(NULL, 0, "p=AQ", 0);
+	ok &= report("empty batch, version only", before);
+
+	before = errors;
+	{
+		Fix zero = makeFix(0, 0, 0);
+		Fix small = makeFix(1, (uint32_t)-1, 64);
+
+		roundTrip(&zero, 1, "p=AQAAAA", 0);			// 01 00 00 00
+		roundTrip(&small, 1, "p=AQIBgAE", 0);		// 01 02 01 80 01
+	}
+	ok &= report("known bodies", before);
+
+	// 3n+1, 3n+2 and 3n bytes
+	before = errors;
+	{
+		Fix ends[3] = { makeFix(0, 0, 0), makeFix(0, 64, 0), makeFix(0, 128, 64) };
+
+		roundTrip(&ends[0], 1, NULL, bodyLength(4));
+		roundTrip(&ends[1], 1, NULL, bodyLength(5));
+		roundTrip(&ends[2], 1, NULL, bodyLength(6));
+		roundTrip(ends, 3, NULL, bodyLength(1 + 3 + 4 + 5));		// deltas of the batch : 0, 64 then 64, 64
+	}
+	ok &= report("base64url end of 3n, 3n+1 and 3n+2 bytes, no '='", before);
+
+	before = errors;
+	{
+		Fix track[] =
+		{
+			makeFix(1700000000, (uint32_t)-335731000, (uint32_t)-76120000),
+			makeFix(1700000010, (uint32_t)-335731100, (uint32_t)-76121000),
+			makeFix(1700000005, (uint32_t)-335730900, (uint32_t)-76119000),		// time going back
+			makeFix(1700000005, (uint32_t)-335730900, (uint32_t)-76119000),		// no move
+			makeFix(1600000000, 335731000, 76120000),							// sign change
+			makeFix(1600000001, 335730999, 76119999),							// -1
+		};
+
+		roundTrip(track, sizeof(track) / sizeof(track[0]), NULL, 0);
+		deltaTrip(-1);
+		deltaTrip(-2);
+	}
+	ok &= report("zig-zag of negative deltas", before);
+
+	before = errors;
+	{
+		// zig-zag 0x7F | 0x80, 0x3FFF | 0x4000, 0x1FFFFF | 0x200000, 0xFFFFFFF | 0x10000000
+		const int32_t boundaries[] = { -64, 63, 64, -65, -8192, 8191, 8192, -8193,
+									   -1048576, 1048575, 1048576, -1048577,
+									   -134217728, 134217727, 134217728, -134217729,
+									   INT32_MAX, INT32_MIN };
+
+		for (uint8_t i = 0; i < sizeof(boundaries) / sizeof(boundaries[0]); i++)
+			deltaTrip(boundaries[i]);
+	}
+	ok &= report("varint boundaries, 1 to 5 bytes", before);
+
+	before = errors;
+	{
+		Fix extremes[] =
+		{
+			makeFix(0, 900000000, 1799999999),
+			makeFix(10, 899999999, (uint32_t)-1799999999),		// across the antimeridian
+			makeFix(20, (uint32_t)-900000000, 1799999999),
+			makeFix(0xFFFFFFFF, INT32_MAX, (uint32_t)INT32_MIN),
+			makeFix(0, (uint32_t)INT32_MIN, INT32_MAX),
+		};
+
+		roundTrip(extremes, sizeof(extremes) / sizeof(extremes[0]), NULL, 0);
+	}
+	ok &= report("antimeridian and extreme values", before);
+
+	// the buffer fills up, the body still ends between two fixes
+	before = errors;
+	for (size_t size = PREFIX_LENGTH + 3; size < 64; size++)
+	{
+		FixEncoder encoder;
+		Fix fixes[MAX_FIXES];
+		char body[64];
+		uint8_t count;
+
+		for (uint8_t i = 0; i < MAX_FIXES; i++)
+			fixes[i] = makeFix(1700000000 + 10 * i, 335731000 + 150 * i * i, -76120000 - 3000 * i);
+
+		encoder.begin(body, size);
+
+		for (count = 0; count < MAX_FIXES && encoder.add(fixes[count]); count++);
+
+		if (encoder.end() >= size || count != encoder.getCount())
+			fail("buffer overrun", body);
+		else
+			decodeAndCompare(body, fixes, count);
+	}
+	ok &= report("full buffer", before);
+
+	before = errors;
+	{
+		Fix small = makeFix(1, (uint32_t)-1, 64);
+
+		decodeAndCompare("p=AQIBgAE&id=12", &small, 1);
+		decodeAndCompare("AQIBgAE", &small, 1);
+	}
+	ok &= report("body followed by a field, body without its name", before);
+
+	before = errors;
+	rejected("p=Ag");						// version 2
+	rejected("p=AQIBgA");					// ends inside a varint
+	rejected("p=AQI*gAE");					// not base64url
+	rejected("p=AQ__________");				// varint never ending
+	rejected("p=AYCAgICAAAAA");				// varint of 6 bytes, 80 80 80 80 80 00
+	ok &= report("malformed bodies rejected", before);
+
+	printf("%s\n", ok ? "all passed" : "failed");
+
+	return ok ? 0 : 1;
+}
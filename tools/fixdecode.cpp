@@ -0,0 +1,84 @@
+/*
+ * fixdecode.cpp
+ *
+ * Host side decoder of the fix batches sent by the tracker (see FixCodec.h).
+ * Each argument, or each line of the standard input when there is none, is
+ * a request body "p=..." ; the fixes are printed as "time,latitude,longitude"
+ * with the time in UTC seconds and the coordinates in degrees.
+ *
+ * Build :	g++ -I../Lib/Header -o fixdecode fixdecode.cpp ../Lib/Src/FixCodec.cpp
+ *
+ * Author: Karim Bouanane
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include "FixCodec.h"
+
+#define LINE_SIZE	1024
+
+
+static void printCoordinate(long value)
+{
+	unsigned long magnitude = value < 0 ? -value : value;
+
+	printf("%s%lu.%07lu", value < 0 ? "-" : "", magnitude / 10000000, magnitude % 10000000);
+}
+
+
+// return false if the body is malformed
+static bool decodeBody(const char* body)
+{
+	FixDecoder decoder;
+	Fix fix;
+
+	if (decoder.begin(body) == false)
+		return false;
+
+	while (decoder.next(&fix))
+	{
+		printf("%lu,", (unsigned long)fix.time);
+		printCoordinate(fix.latitude);
+		printf(",");
+		printCoordinate(fix.longitude);
+		printf("\n");
+	}
+
+	return decoder.isValid();
+}
+
+
+int main(int argc, char* argv[])
+{
+	char line[LINE_SIZE];
+	int status = EXIT_SUCCESS;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (decodeBody(argv[i]) == false)
+		{
+			fprintf(stderr, "fixdecode: malformed body \"%s\"\n", argv[i]);
+			status = EXIT_FAILURE;
+		}
+	}
+
+	if (argc > 1)
+		return status;
+
+	while (fgets(line, sizeof(line), stdin) != NULL)
+	{
+		line[strcspn(line, "\r\n")] = '\0';
+
+		if (line[0] == '\0')
+			continue;
+
+		if (decodeBody(line) == false)
+		{
+			fprintf(stderr, "fixdecode: malformed body \"%s\"\n", line);
+			status = EXIT_FAILURE;
+		}
+	}
+
+	return status;
+}
@@ -0,0 +1,18 @@
+/*
+ * interrupt.h
+ *
+ * Host stand-in of <avr/interrupt.h>. An interrupt routine becomes a plain
+ * function, the tool calls it where the hardware would raise the interrupt.
+ *
+ * Author: Karim Bouanane
+ */
+
+#ifndef HOST_AVR_INTERRUPT_H_
+#define HOST_AVR_INTERRUPT_H_
+
+#define ISR(vector)		extern "C" void vector(void)
+
+#define sei()
+#define cli()
+
+#endif /* HOST_AVR_INTERRUPT_H_ */
@@ -0,0 +1,30 @@
+/*
+ * io.h
+ *
+ * Host stand-in of <avr/io.h> for the tools building a library of the
+ * tracker. Only the registers of Timer1 are given, they are plain
+ * variables defined by the tool, which sets them as the hardware would.
+ *
+ * Author: Karim Bouanane
+ */
+
+#ifndef HOST_AVR_IO_H_
+#define HOST_AVR_IO_H_
+
+#include <stdint.h>
+
+#define _BV(bit)	(1 << (bit))
+
+// Timer1
+extern volatile uint8_t TCCR1A;
+extern volatile uint8_t TCCR1B;
+extern volatile uint16_t TCNT1;
+extern volatile uint8_t TIFR1;
+extern volatile uint8_t TIMSK1;
+
+#define TOV1		0
+#define TOIE1		0
+#define CS10		0
+#define CS11		1
+
+#endif /* HOST_AVR_IO_H_ */
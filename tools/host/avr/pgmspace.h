@@ -0,0 +1,27 @@
+/*
+ * pgmspace.h
+ *
+ * Host stand-in of <avr/pgmspace.h>. The tables stay in the data memory of
+ * the host, they are read like any other variable.
+ *
+ * Author: Karim Bouanane
+ */
+
+#ifndef HOST_AVR_PGMSPACE_H_
+#define HOST_AVR_PGMSPACE_H_
+
+#include <stdint.h>
+#include <string.h>
+
+#define PROGMEM
+#define PSTR(s)				(s)
+
+#define pgm_read_byte(address)	(*(const uint8_t*)(address))
+#define pgm_read_word(address)	(*(const uint16_t*)(address))
+#define pgm_read_dword(address)	(*(const uint32_t*)(address))
+#define pgm_read_ptr(address)	(*(void* const*)(address))
+
+#define memcpy_P			memcpy
+#define strlen_P			strlen
+
+#endif /* HOST_AVR_PGMSPACE_H_ */
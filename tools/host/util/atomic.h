@@ -0,0 +1,18 @@
+/*
+ * atomic.h
+ *
+ * Host stand-in of <util/atomic.h>. Nothing interrupts the tool, the block
+ * is run once as it is.
+ *
+ * Author: Karim Bouanane
+ */
+
+#ifndef HOST_UTIL_ATOMIC_H_
+#define HOST_UTIL_ATOMIC_H_
+
+#define ATOMIC_RESTORESTATE
+#define ATOMIC_FORCEON
+
+#define ATOMIC_BLOCK(type)	for (int atomicDone = 0; atomicDone == 0; atomicDone = 1)
+
+#endif /* HOST_UTIL_ATOMIC_H_ */
@@ -0,0 +1,572 @@
+/*
+ * kalmansim.cpp
+ *
+ * Host side harness of KalmanFilter. The filter of the tracker is run on a
+ * track and its cost on the ATmega328P is estimated from an op-count model.
+ *
+ *		kalmansim				synthetic track, the error of the raw and of the
+ *								filtered positions is printed
+ *		kalmansim track.csv		replay of a recorded track, the filtered track is
+ *								printed as csv
+ *
+ * The synthetic track is 600 fixes at 1 Hz : parked, 300 s at 10 m/s north and
+ * 5 m/s east, parked again. Each position has a gaussian noise of 3 m, the
+ * fix 250 has a multipath jump of 80 m to the north.
+ *
+ * A line of the recorded track is "iTOW,latitude,longitude,hAcc,velN,velE,sAcc"
+ * with the units of NavSolution (ms, 1e-7 deg, mm, mm/s), sAcc is 0 for a
+ * NAV_POSLLH fix. The output lines are "iTOW,latitude,longitude,accepted".
+ *
+ * Op-count model : the AVR has no divider and only an 8 bit multiplier, the
+ * time of update() is the time of the libgcc routines of the 32 bit
+ * multiplications and divisions, and of isqrt32(). The count of each part
+ * is read from the "// cost :" comment above its definition in
+ * KalmanFilter.cpp and Geo.cpp (SOURCE_DIR, run from tools/), a missing
+ * part is an error. The paths taken by update() are recognized from outside
+ * and weighted by those counts. The cycles of the routines are estimates,
+ * to be replaced by the times measured on the board with timerMicros()
+ * around update(). moveOrigin() can't be seen from outside, its cost is
+ * given apart and added to the worst case.
+ *
+ * long is 64 bit on the host, 32 bit on the AVR : the clamps of the filter
+ * keep the 32 bit products in range, the results are the same.
+ *
+ * Build :	g++ -Ihost -I../Lib/Header -o kalmansim kalmansim.cpp ../Lib/Src/KalmanFilter.cpp ../Lib/Src/Geo.cpp
+ *
+ * Author: Karim Bouanane
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <ctype.h>
+#include <math.h>
+#include "KalmanFilter.h"
+#include "Geo.h"
+
+#define F_CPU_MHZ			16
+
+#ifndef SOURCE_DIR
+#define SOURCE_DIR			"../Lib/Src/"
+#endif
+
+// estimated cycles of the libgcc routines on the ATmega328P
+#define CYCLES_MUL32		40			// __mulsi3
+#define CYCLES_DIV32		650			// __divmodsi4
+#define CYCLES_ISQRT32		400			// isqrt32 of Geo.cpp, 16 rounds
+
+#define TRACK_LENGTH		600			// fixes of the synthetic track
+#define TRACK_NOISE			3.0			// m
+#define TRACK_JUMP			80.0		// m
+#define TRACK_JUMP_FIX		250
+#define METERS_PER_DEG		111320.0
+
+#define LINE_SIZE			256
+
+
+// operations of one part of the filter
+typedef struct
+{
+	const char* name;
+	uint8_t mul32;
+	uint8_t div32;
+	uint8_t isqrt32;
+
+} OpCount;
+
+typedef enum
+{
+	PART_ACCURACY,			// accuracyVariance
+	PART_STEP,				// startStep
+	PART_PREDICT,			// predictAxis
+	PART_NORTH,				// toNorth
+	PART_EAST,				// toEast
+	PART_OUTLIER,			// isOutlier
+	PART_POSITION,			// updatePosition
+	PART_VELOCITY,			// updateVelocity
+	PART_COS,				// geoCos
+	PART_LATITUDE,			// getLatitude
+	PART_LONGITUDE,			// getLongitude
+	PART_COUNT
+
+} Part;
+
+// filled from the cost comments of the sources
+static OpCount parts[PART_COUNT] =
+{
+	{ "accuracyVariance", 0, 0, 0 },
+	{ "startStep", 0, 0, 0 },
+	{ "predictAxis", 0, 0, 0 },
+	{ "toNorth", 0, 0, 0 },
+	{ "toEast", 0, 0, 0 },
+	{ "isOutlier", 0, 0, 0 },
+	{ "updatePosition", 0, 0, 0 },
+	{ "updateVelocity", 0, 0, 0 },
+	{ "geoCos", 0, 0, 0 },
+	{ "getLatitude", 0, 0, 0 },
+	{ "getLongitude", 0, 0, 0 },
+};
+
+static bool partLoaded[PART_COUNT];
+
+// paths of update()
+typedef enum
+{
+	PATH_START,				// first fix or gap, the filter starts on it
+	PATH_OUTLIER,			// ignored as an outlier
+	PATH_RESTART,			// outlier after KALMAN_MAX_OUTLIERS - 1 others, the filter starts on it
+	PATH_POSITION,			// position measured (NAV_POSLLH)
+	PATH_VELOCITY,			// position and velocity measured (NAV_PVT)
+	PATH_MOVE_ORIGIN,		// extra of moveOrigin, not seen from outside
+	PATH_COUNT
+
+} Path;
+
+static const char* pathNames[PATH_COUNT] =
+{
+	"start", "outlier", "restart", "position", "position+velocity", "moveOrigin (extra)"
+};
+
+static long pathCounts[PATH_COUNT];
+
+
+/**** Op-count model ****/
+
+static void addPart(OpCount* total, Part part, uint8_t times)
+{
+	total->mul32 += parts[part].mul32 * times;
+	total->div32 += parts[part].div32 * times;
+	total->isqrt32 += parts[part].isqrt32 * times;
+}
+
+
+// operations of one path, the outlier gate is counted on both axes
+static OpCount pathOps(Path path)
+{
+	OpCount ops = { pathNames[path], 0, 0, 0 };
+
+	if (path == PATH_MOVE_ORIGIN)
+	{
+		addPart(&ops, PART_LATITUDE, 1);
+		addPart(&ops, PART_LONGITUDE, 1);
+		addPart(&ops, PART_NORTH, 1);
+		addPart(&ops, PART_EAST, 1);
+		addPart(&ops, PART_COS, 1);
+		return ops;
+	}
+
+	addPart(&ops, PART_ACCURACY, 1);		// r of the position
+
+	if (path != PATH_START)
+	{
+		addPart(&ops, PART_STEP, 1);
+		addPart(&ops, PART_PREDICT, 2);
+		addPart(&ops, PART_NORTH, 1);
+		addPart(&ops, PART_EAST, 1);
+		addPart(&ops, PART_OUTLIER, 2);
+	}
+
+	if (path == PATH_START || path == PATH_RESTART)
+	{
+		addPart(&ops, PART_ACCURACY, 2);	// r and rv of start()
+		addPart(&ops, PART_COS, 1);
+	}
+
+	if (path == PATH_POSITION || path == PATH_VELOCITY)
+		addPart(&ops, PART_POSITION, 2);
+
+	if (path == PATH_VELOCITY)
+	{
+		addPart(&ops, PART_ACCURACY, 1);	// r of the velocity
+		addPart(&ops, PART_VELOCITY, 2);
+	}
+
+	return ops;
+}
+
+
+static long opCycles(const OpCount* ops)
+{
+	return (long)ops->mul32 * CYCLES_MUL32 + (long)ops->div32 * CYCLES_DIV32 +
+		   (long)ops->isqrt32 * CYCLES_ISQRT32;
+}
+
+
+static void printCost(FILE* out)
+{
+	long updates = 0;
+	long cycles = 0;
+	OpCount ops;
+	OpCount worst;
+
+	fprintf(out, "\n%-20s %7s %6s %6s %6s %9s %7s\n",
+			"path", "count", "mul32", "div32", "isqrt", "cycles", "us");
+
+	for (uint8_t i = 0; i < PATH_COUNT; i++)
+	{
+		ops = pathOps((Path)i);
+
+		if (i == PATH_MOVE_ORIGIN)
+			fprintf(out, "%-20s %7s", ops.name, "-");
+		else
+			fprintf(out, "%-20s %7ld", ops.name, pathCounts[i]);
+
+		fprintf(out, " %6u %6u %6u %9ld %7ld\n",
+				ops.mul32, ops.div32, ops.isqrt32, opCycles(&ops), opCycles(&ops) / F_CPU_MHZ);
+
+		if (i != PATH_MOVE_ORIGIN)
+		{
+			updates += pathCounts[i];
+			cycles += pathCounts[i] * opCycles(&ops);
+		}
+	}
+
+	worst = pathOps(PATH_VELOCITY);
+	ops = pathOps(PATH_MOVE_ORIGIN);
+	worst.mul32 += ops.mul32;
+	worst.div32 += ops.div32;
+	worst.isqrt32 += ops.isqrt32;
+
+	if (updates != 0)
+		fprintf(out, "\nmean %ld cycles (%ld us) per update over %ld updates\n",
+				cycles / updates, cycles / updates / F_CPU_MHZ, updates);
+
+	fprintf(out, "worst %ld cycles (%ld us), position+velocity with moveOrigin\n",
+			opCycles(&worst), opCycles(&worst) / F_CPU_MHZ);
+}
+
+
+// counts of a line "// cost : 15 mul32, 2 div32", false for another line
+static bool parseCost(const char* line, OpCount* cost)
+{
+	const char* p;
+
+	if (strncmp(line, "// cost :", 9) != 0)
+		return false;
+
+	cost->mul32 = 0;
+	cost->div32 = 0;
+	cost->isqrt32 = 0;
+	p = line + 9;
+
+	for (;;)
+	{
+		char* end;
+		unsigned long count = strtoul(p, &end, 10);
+
+		if (end == p)
+			return true;
+
+		p = end;
+
+		while (*p == ' ')
+			p++;
+
+		if (strncmp(p, "mul32", 5) == 0)
+			cost->mul32 = count;
+		else if (strncmp(p, "div32", 5) == 0)
+			cost->div32 = count;
+		else if (strncmp(p, "isqrt32", 7) == 0)
+			cost->isqrt32 = count;
+		else
+			fprintf(stderr, "unknown routine in %s", line);
+
+		while (*p != ',' && *p != '\0')
+			p++;
+
+		if (*p == ',')
+			p++;
+	}
+}
+
+
+// true if the line is the definition of the function name, not a call
+static bool isDefinition(const char* line, const char* name)
+{
+	const char* found = strstr(line, name);
+	size_t length = strlen(name);
+
+	if (isspace((unsigned char)line[0]) || found == NULL || found[length] != '(')
+		return false;
+
+	return found == line || (isalnum((unsigned char)found[-1]) == 0 && found[-1] != '_');
+}
+
+
+// give the counts of the cost comments of a source to the parts defined below them
+static bool loadCosts(const char* file)
+{
+	char path[LINE_SIZE];
+	char line[LINE_SIZE];
+	OpCount cost = {};
+	bool pending = false;
+	FILE* source;
+
+	snprintf(path, sizeof(path), "%s%s", SOURCE_DIR, file);
+	source = fopen(path, "r");
+
+	if (source == NULL)
+	{
+		fprintf(stderr, "can't open %s\n", path);
+		return false;
+	}
+
+	while (fgets(line, sizeof(line), source) != NULL)
+	{
+		if (parseCost(line, &cost))
+		{
+			pending = true;
+			continue;
+		}
+
+		// the comment is right above the definition
+		if (pending == false || strncmp(line, "//", 2) == 0)
+			continue;
+
+		pending = false;
+
+		for (uint8_t i = 0; i < PART_COUNT; i++)
+		{
+			if (isDefinition(line, parts[i].name))
+			{
+				parts[i].mul32 = cost.mul32;
+				parts[i].div32 = cost.div32;
+				parts[i].isqrt32 = cost.isqrt32;
+				partLoaded[i] = true;
+			}
+		}
+	}
+
+	fclose(source);
+
+	return true;
+}
+
+
+static bool loadParts()
+{
+	bool ok = loadCosts("KalmanFilter.cpp") && loadCosts("Geo.cpp");
+
+	for (uint8_t i = 0; i < PART_COUNT; i++)
+	{
+		if (partLoaded[i] == false)
+		{
+			fprintf(stderr, "no cost comment above %s\n", parts[i].name);
+			ok = false;
+		}
+	}
+
+	return ok;
+}
+
+
+/**** Filter ****/
+
+// accuracy of a filter just started on the fix, mm
+static uint32_t startAccuracy(const NavSolution* nav)
+{
+	long cm = nav->hAcc / 10;
+
+	if (cm > KALMAN_MAX_ACCURACY)
+		cm = KALMAN_MAX_ACCURACY;
+
+	return (uint32_t)isqrt32(2 * (cm == 0 ? 1 : cm * cm)) * 10;
+}
+
+
+// give the fix to the filter and count the path it took
+static bool runFilter(KalmanFilter* filter, const NavSolution* nav, bool first, uint32_t dt)
+{
+	bool accepted = filter->update(nav);
+
+	// a filter started on the fix sits exactly on it, with the accuracy of the fix.
+	// A measured fix always leaves a smaller variance
+	bool started = accepted &&
+				   filter->getLatitude() == nav->latitude &&
+				   filter->getLongitude() == nav->longitude &&
+				   filter->getAccuracy() == startAccuracy(nav);
+
+	if (first || dt > KALMAN_MAX_GAP)
+		pathCounts[PATH_START]++;
+	else if (accepted == false)
+		pathCounts[PATH_OUTLIER]++;
+	else if (started)
+		pathCounts[PATH_RESTART]++;
+	else if (nav->sAcc != 0)
+		pathCounts[PATH_VELOCITY]++;
+	else
+		pathCounts[PATH_POSITION]++;
+
+	return accepted;
+}
+
+
+/**** Synthetic track ****/
+
+static uint32_t randomState = 1;
+
+// xorshift, the same track on every host
+static double uniform()
+{
+	randomState ^= randomState << 13;
+	randomState ^= randomState >> 17;
+	randomState ^= randomState << 5;
+
+	return randomState / 4294967296.0;
+}
+
+
+// standard normal, sum of 12 uniforms
+static double gaussian()
+{
+	double sum = 0;
+
+	for (uint8_t i = 0; i < 12; i++)
+		sum += uniform();
+
+	return sum - 6;
+}
+
+
+static int simulate()
+{
+	KalmanFilter filter;
+	NavSolution nav = {};
+	double lat = 33.7;			// deg, true position
+	double lng = -7.5;
+	double errorRaw = 0;
+	double errorFilter = 0;
+	double worstFilter = 0;
+	bool jumpRejected = false;
+	int count = 0;
+
+	for (int i = 0; i < TRACK_LENGTH; i++)
+	{
+		bool moving = i >= 100 && i < 400;
+		double vn = moving ? 10 : 0;		// m/s
+		double ve = moving ? 5 : 0;
+		double metersPerDegLng;
+		double noiseNorth = gaussian() * TRACK_NOISE;
+		double noiseEast = gaussian() * TRACK_NOISE;
+
+		lat += vn / METERS_PER_DEG;
+		metersPerDegLng = METERS_PER_DEG * cos(lat * M_PI / 180);
+		lng += ve / metersPerDegLng;
+
+		if (i == TRACK_JUMP_FIX)
+			noiseNorth += TRACK_JUMP;
+
+		nav.iTOW = i * 1000;
+		nav.hAcc = 4000;
+		nav.sAcc = 500;
+		nav.latitude = lround((lat + noiseNorth / METERS_PER_DEG) * 1e7);
+		nav.longitude = lround((lng + noiseEast / metersPerDegLng) * 1e7);
+		nav.velN = lround((vn + gaussian() * 0.3) * 1000);
+		nav.velE = lround((ve + gaussian() * 0.3) * 1000);
+
+		bool accepted = runFilter(&filter, &nav, i == 0, 1000);
+
+		if (i == TRACK_JUMP_FIX)
+			jumpRejected = accepted == false;
+
+		// errors in m, once the filter had a few fixes to settle
+		double dn = (filter.getLatitude() / 1e7 - lat) * METERS_PER_DEG;
+		double de = (filter.getLongitude() / 1e7 - lng) * metersPerDegLng;
+		double rn = (nav.latitude / 1e7 - lat) * METERS_PER_DEG;
+		double re = (nav.longitude / 1e7 - lng) * metersPerDegLng;
+
+		if (i > 5)
+		{
+			errorFilter += dn * dn + de * de;
+			errorRaw += rn * rn + re * re;
+			count++;
+
+			if (sqrt(dn * dn + de * de) > worstFilter)
+				worstFilter = sqrt(dn * dn + de * de);
+		}
+	}
+
+	printf("synthetic track : %d fixes, noise %.0f m, jump of %.0f m at fix %d\n",
+		   TRACK_LENGTH, TRACK_NOISE, TRACK_JUMP, TRACK_JUMP_FIX);
+	printf("rms error  raw %.2f m  filtered %.2f m  (worst filtered %.2f m)\n",
+		   sqrt(errorRaw / count), sqrt(errorFilter / count), worstFilter);
+	printf("jump %s, %u outliers\n", jumpRejected ? "rejected" : "ACCEPTED", filter.getOutlierCount());
+
+	printCost(stdout);
+
+	return jumpRejected ? 0 : 1;
+}
+
+
+/**** Recorded track ****/
+
+static int replay(const char* path)
+{
+	KalmanFilter filter;
+	NavSolution nav = {};
+	FILE* file = fopen(path, "r");
+	char line[LINE_SIZE];
+	uint32_t lastTOW = 0;
+	bool first = true;
+	long lineNumber = 0;
+
+	if (file == NULL)
+	{
+		fprintf(stderr, "can't open %s\n", path);
+		return 1;
+	}
+
+	while (fgets(line, sizeof(line), file) != NULL)
+	{
+		unsigned long iTOW;
+		unsigned long hAcc;
+		unsigned long sAcc;
+		long latitude;
+		long longitude;
+		long velN;
+		long velE;
+
+		lineNumber++;
+
+		if (sscanf(line, "%lu,%ld,%ld,%lu,%ld,%ld,%lu", &iTOW, &latitude, &longitude, &hAcc, &velN, &velE, &sAcc) != 7)
+		{
+			fprintf(stderr, "line %ld skipped\n", lineNumber);
+			continue;
+		}
+
+		nav.iTOW = iTOW;
+		nav.latitude = latitude;
+		nav.longitude = longitude;
+		nav.hAcc = hAcc;
+		nav.velN = velN;
+		nav.velE = velE;
+		nav.sAcc = sAcc;
+
+		bool accepted = runFilter(&filter, &nav, first, nav.iTOW - lastTOW);
+
+		printf("%lu,%ld,%ld,%d\n", iTOW, filter.getLatitude(), filter.getLongitude(), accepted);
+
+		lastTOW = nav.iTOW;
+		first = false;
+	}
+
+	fclose(file);
+
+	fprintf(stderr, "%u outliers\n", filter.getOutlierCount());
+	printCost(stderr);
+
+	return 0;
+}
+
+
+int main(int argc, char* argv[])
+{
+	if (loadParts() == false)
+		return 1;
+
+	if (argc > 1)
+		return replay(argv[1]);
+
+	return simulate();
+}
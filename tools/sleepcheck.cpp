@@ -0,0 +1,78 @@
+/*
+ * sleepcheck.cpp
+ *
+ * Host side check of the watchdog chain of PowerManager (see WDTChain.h).
+ * The loop of PowerManager::sleepUntil() is run for several calibrations
+ * and sleep lengths, each period lasting what the calibration says. The
+ * sleep must end, never pass the deadline, and leave less than the
+ * shortest period to the idle tail. A line is printed for each case, the
+ * exit status is 1 if one of them fails.
+ *
+ * Build :	g++ -I../Lib/Header -o sleepcheck sleepcheck.cpp ../Lib/Src/WDTChain.cpp
+ *
+ * Author: Karim Bouanane
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include "WDTChain.h"
+
+#define MAX_PERIODS		1000000L	// more periods than this means the loop doesn't end
+
+
+static const uint16_t calibrations[] = { 512, 900, 950, 1000, 1023, 1024, 1025, 1100, 1200, 2048 };
+static const int32_t sleeps[] = { 15, 16, 17, 100, 999, 1000, 8191, 60000, 600000, 3600000L, 86400000L };
+
+
+// return false if the sleep doesn't end or is wrongly accounted
+static bool check(uint16_t calibration, int32_t ms)
+{
+	WDTChain chain;
+	uint64_t elapsed = 0;			// us, actual time slept
+	uint32_t slept = 0;				// ms, credited by the chain
+	int32_t left = ms;
+	long periods = 0;
+	uint8_t index;
+	bool ok;
+
+	chain.setCalibration(calibration);
+
+	// same loop as PowerManager::sleepUntil(), sleepPeriod() replaced by the actual length
+	while ((index = chain.next(left)) != WDT_CHAIN_DONE && periods < MAX_PERIODS)
+	{
+		elapsed += (uint64_t)calibration * 1000 * (16 << index) / WDT_NOMINAL;
+
+		uint16_t credit = chain.credit(index);
+		slept += credit;
+		left -= credit;
+		periods++;
+	}
+
+	// the credit is the actual time in whole ms, the idle tail waits the rest
+	ok = periods < MAX_PERIODS &&
+		 slept == elapsed / 1000 &&
+		 elapsed <= (uint64_t)ms * 1000 &&
+		 (uint64_t)ms * 1000 - elapsed < chain.periodMicros(0);
+
+	printf("%s calibration %4u ms  sleep %9ld ms  slept %9lu ms  tail %5lu us  %ld periods\n",
+		   ok ? "ok  " : "FAIL", calibration, (long)ms, (unsigned long)slept,
+		   (unsigned long)((uint64_t)ms * 1000 - elapsed), periods);
+
+	return ok;
+}
+
+
+int main()
+{
+	bool ok = true;
+
+	for (size_t i = 0; i < sizeof(calibrations) / sizeof(calibrations[0]); i++)
+	{
+		for (size_t j = 0; j < sizeof(sleeps) / sizeof(sleeps[0]); j++)
+			ok &= check(calibrations[i], sleeps[j]);
+	}
+
+	printf("%s\n", ok ? "all passed" : "failed");
+
+	return ok ? 0 : 1;
+}
@@ -0,0 +1,212 @@
+/*
+ * timercheck.cpp
+ *
+ * Host side check of the time given by Timer.cpp. The library is built
+ * against the stand-ins of tools/host, the Timer1 registers are variables
+ * moved here as the counter would run, and the overflow interrupt is called
+ * where the hardware would raise it. Each reading of timerNow() and
+ * timerMicros() is compared with the actual time, in particular :
+ *
+ *		- the counter has wrapped but its interrupt is still pending,
+ *		  TOV1 is set while TCNT1 is low
+ *		- TOV1 is set while TCNT1 is still high, the counter was read just
+ *		  before the wrap
+ *		- the us wrap after 2^32 us (71 min), the ms keep counting
+ *		- the ms added by timerAdvance() after a sleep
+ *
+ * A line is printed for each case, the exit status is 1 if one of them fails.
+ *
+ * Build :	g++ -Ihost -I../Lib/Header -o timercheck timercheck.cpp ../Lib/Src/Timer.cpp
+ *
+ * Author: Karim Bouanane
+ */
+
+#include <stdio.h>
+#include <stdint.h>
+#include "Timer.h"
+
+#define US_PER_TICK			4
+#define TICKS_PER_OVERFLOW	65536UL
+#define WRAP_OVERFLOWS		16384UL		// 2^32 us / 262144 us per overflow
+
+// Timer1 registers of the stand-in avr/io.h
+volatile uint8_t TCCR1A;
+volatile uint8_t TCCR1B;
+volatile uint16_t TCNT1;
+volatile uint8_t TIFR1;
+volatile uint8_t TIMSK1;
+
+extern "C" void TIMER1_OVF_vect(void);
+
+static uint64_t overflows;		// wraps of the counter since the start
+static uint64_t advanced;		// us added by timerAdvance()
+static long readings;
+static long errors;
+
+
+// actual time since the start, in us
+static uint64_t actualMicros()
+{
+	return overflows * TICKS_PER_OVERFLOW * US_PER_TICK + (uint64_t)TCNT1 * US_PER_TICK + advanced;
+}
+
+
+// move the counter forward, a wrap sets TOV1 and leaves the interrupt pending
+static void run(uint32_t ticks)
+{
+	uint32_t count = (uint32_t)TCNT1 + ticks;
+
+	if (count >= TICKS_PER_OVERFLOW)
+	{
+		overflows++;
+		TIFR1 |= _BV(TOV1);
+	}
+
+	TCNT1 = (uint16_t)count;
+}
+
+
+// the pending interrupt is served, the hardware clears TOV1
+static void serve()
+{
+	if (TIFR1 & _BV(TOV1))
+	{
+		TIMER1_OVF_vect();
+		TIFR1 &= ~_BV(TOV1);
+	}
+}
+
+
+// compare one reading of the library with the actual time
+static bool expect(const char* where)
+{
+	uint64_t actual = actualMicros();
+	uint32_t micros = timerMicros();
+	uint32_t millis = timerNow();
+
+	readings++;
+
+	if (micros == (uint32_t)actual && millis == (uint32_t)(actual / 1000))
+		return true;
+
+	if (errors++ < 10)
+	{
+		printf("  %s : actual %llu us, timerMicros %lu us, timerNow %lu ms\n", where,
+			   (unsigned long long)actual, (unsigned long)micros, (unsigned long)millis);
+	}
+
+	return false;
+}
+
+
+static bool report(const char* name, long before)
+{
+	bool ok = errors == before;
+
+	printf("%s %s\n", ok ? "ok  " : "FAIL", name);
+
+	return ok;
+}
+
+
+int main()
+{
+	bool ok = true;
+	long before;
+
+	timerNow();						// first call, the library starts Timer1
+	TIFR1 = 0;						// a 1 written to TOV1 clears it on the hardware
+
+	before = errors;
+	expect("start");
+	run(1000);
+	expect("1000 ticks");
+	ok &= report("start of the counter", before);
+
+	// the counter wraps while the interrupts are disabled, TOV1 is set and
+	// TCNT1 is already low : the overflow must be counted once, before and after the interrupt
+	before = errors;
+	run(TICKS_PER_OVERFLOW - 1000 - 3);
+	expect("3 ticks before the wrap");
+	run(13);
+	expect("interrupt pending, TCNT1 = 10");
+	serve();
+	expect("interrupt served, TCNT1 = 10");
+	ok &= report("pending overflow, TOV1 set while TCNT1 is low", before);
+
+	// the counter is read just before it wraps, TOV1 is seen set in the same block :
+	// this overflow is not part of the reading yet
+	before = errors;
+	run(TICKS_PER_OVERFLOW - 10 - 2);
+	TIFR1 |= _BV(TOV1);				// set by the wrap that comes right after TCNT1 was read
+	expect("TOV1 set, TCNT1 = 0xFFFE");
+	TIFR1 &= ~_BV(TOV1);
+	run(2);							// the wrap itself
+	serve();
+	expect("after the wrap");
+	ok &= report("TOV1 set while TCNT1 is still high", before);
+
+	// several days of counting, read at each step and while each interrupt is pending
+	before = errors;
+
+	while (overflows < 3 * WRAP_OVERFLOWS)
+	{
+		run(TICKS_PER_OVERFLOW / 3 + 7);
+
+		if (TIFR1 & _BV(TOV1))
+		{
+			expect("interrupt pending");
+			serve();
+		}
+
+		expect("counting");
+	}
+
+	ok &= report("us wrap after 71 min, three times", before);
+
+	// the us difference across a wrap is still the elapsed time
+	before = errors;
+	{
+		uint32_t start;
+		uint32_t elapsed;
+		uint8_t i;
+
+		while ((overflows + 2) % WRAP_OVERFLOWS != 0)
+		{
+			run(TICKS_PER_OVERFLOW / 2);
+			serve();
+		}
+
+		start = timerMicros();
+
+		for (i = 0; i < 8; i++)		// 4 overflows, the us wrap in the middle
+		{
+			run(TICKS_PER_OVERFLOW / 2);
+			serve();
+		}
+
+		elapsed = timerMicros() - start;
+
+		if (elapsed != TICKS_PER_OVERFLOW * 4 * US_PER_TICK)
+		{
+			printf("  elapsed %lu us across the wrap\n", (unsigned long)elapsed);
+			errors++;
+		}
+	}
+	ok &= report("elapsed us across the wrap", before);
+
+	// Timer1 stops in power-down, the sleep is added with timerAdvance()
+	before = errors;
+	timerAdvance(8000);
+	advanced += 8000000ULL;
+	expect("after a sleep of 8 s");
+	run(TICKS_PER_OVERFLOW - TCNT1 + 5);
+	expect("interrupt pending after the sleep");
+	serve();
+	expect("interrupt served after the sleep");
+	ok &= report("sleep added by timerAdvance", before);
+
+	printf("%ld readings, %s\n", readings, ok ? "all passed" : "failed");
+
+	return ok ? 0 : 1;
+}
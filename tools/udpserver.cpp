@@ -0,0 +1,256 @@
+/*
+ * udpserver.cpp
+ *
+ * Stand-in server of the UDP reporting mode (see UDPWindow.h), to test the
+ * protocol on a Linux host. Each datagram is acknowledged with the highest
+ * sequence number received from its device and the bitmap of the previous
+ * ones, the fixes received for the first time are printed as
+ * "id,seq,time,latitude,longitude". A new session number means the device
+ * was reset, its sequence numbers are tracked again from the datagram.
+ *
+ * Build :	g++ -I../Lib/Header -o udpserver udpserver.cpp ../Lib/Src/FixCodec.cpp
+ * Usage :	udpserver [-p port] [-l loss percent]
+ *
+ * The loss option drops the given share of the datagrams without answering,
+ * to check the retransmission of the device.
+ *
+ * Author: Karim Bouanane
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include "FixCodec.h"
+
+#define DEFAULT_PORT		5005
+#define MAX_DEVICES			16
+#define DEVICE_ID_SIZE		16
+#define DATAGRAM_SIZE		512
+#define ACK_BITS			32
+
+
+typedef struct
+{
+	char id[DEVICE_ID_SIZE];
+	uint16_t session;			// start of the device the sequence numbers belong to
+	uint16_t seq;				// highest sequence number received
+	uint32_t bitmap;			// bit k set when seq - 1 - k was received
+	bool started;				// seq holds a datagram received in this session
+
+} Device;
+
+static Device devices[MAX_DEVICES];
+static int deviceCount;
+
+
+// first datagram of the device or of its session, nothing before it is expected
+static void startSession(Device* device, uint16_t session)
+{
+	device->session = session;
+	device->seq = 0;
+	device->bitmap = 0;
+	device->started = false;
+}
+
+
+static Device* findDevice(const char* id, uint16_t session)
+{
+	for (int i = 0; i < deviceCount; i++)
+	{
+		if (strcmp(devices[i].id, id) != 0)
+			continue;
+
+		if (devices[i].session != session)
+		{
+			fprintf(stderr, "udpserver: %s started again, session %u\n", id, session);
+			startSession(&devices[i], session);
+		}
+
+		return &devices[i];
+	}
+
+	if (deviceCount == MAX_DEVICES)
+		return NULL;
+
+	Device* device = &devices[deviceCount++];
+
+	snprintf(device->id, sizeof(device->id), "%s", id);
+	startSession(device, session);
+
+	return device;
+}
+
+
+// record seq, return false if it was already received
+static bool receive(Device* device, uint16_t seq)
+{
+	int16_t distance = (int16_t)(seq - device->seq);
+
+	// nothing is acknowledged before the first datagram
+	if (device->started == false)
+	{
+		device->seq = seq;
+		device->started = true;
+		return true;
+	}
+
+	if (distance > 0)
+	{
+		// the previous highest becomes bit distance - 1
+		if (distance > ACK_BITS)
+			device->bitmap = 0;
+		else
+			device->bitmap = (uint32_t)(((uint64_t)device->bitmap << distance) | (1ULL << (distance - 1)));
+
+		device->seq = seq;
+		return true;
+	}
+
+	if (distance == 0 || -distance > ACK_BITS)
+		return false;			// duplicate, or too old to be tracked
+
+	uint32_t bit = 1UL << (-distance - 1);
+
+	if (device->bitmap & bit)
+		return false;
+
+	device->bitmap |= bit;
+	return true;
+}
+
+
+// copy the value of field in the form body, return false if it is missing
+static bool getField(const char* body, const char* field, char* value, size_t len)
+{
+	size_t fieldLength = strlen(field);
+	const char* start = body;
+
+	while (start != NULL)
+	{
+		if (strncmp(start, field, fieldLength) == 0 && start[fieldLength] == '=')
+		{
+			start += fieldLength + 1;
+			size_t length = strcspn(start, "&");
+
+			if (length >= len)
+				return false;
+
+			memcpy(value, start, length);
+			value[length] = '\0';
+			return true;
+		}
+
+		start = strchr(start, '&');
+
+		if (start != NULL)
+			start++;
+	}
+
+	return false;
+}
+
+
+static void printFixes(const char* id, uint16_t seq, const char* payload)
+{
+	FixDecoder decoder;
+	Fix fix;
+
+	if (decoder.begin(payload) == false)
+	{
+		fprintf(stderr, "udpserver: malformed fix from %s\n", id);
+		return;
+	}
+
+	while (decoder.next(&fix))
+		printf("%s,%u,%lu,%ld,%ld\n", id, seq, (unsigned long)fix.time, (long)fix.latitude, (long)fix.longitude);
+
+	fflush(stdout);
+}
+
+
+int main(int argc, char* argv[])
+{
+	int port = DEFAULT_PORT;
+	int loss = 0;
+	int option;
+
+	while ((option = getopt(argc, argv, "p:l:")) != -1)
+	{
+		switch (option)
+		{
+			case 'p':	port = atoi(optarg);	break;
+			case 'l':	loss = atoi(optarg);	break;
+
+			default:
+				fprintf(stderr, "usage: %s [-p port] [-l loss percent]\n", argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	int sock = socket(AF_INET, SOCK_DGRAM, 0);
+
+	struct sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_ANY);
+	address.sin_port = htons(port);
+
+	if (sock < 0 || bind(sock, (struct sockaddr*)&address, sizeof(address)) < 0)
+	{
+		perror("udpserver");
+		return EXIT_FAILURE;
+	}
+
+	fprintf(stderr, "udpserver: listening on port %d, loss %d%%\n", port, loss);
+
+	while (1)
+	{
+		char datagram[DATAGRAM_SIZE];
+		char id[DEVICE_ID_SIZE];
+		char sessionText[8];
+		char seqText[8];
+		char payload[DATAGRAM_SIZE];
+		char ack[32];
+		struct sockaddr_in client;
+		socklen_t clientLength = sizeof(client);
+
+		ssize_t length = recvfrom(sock, datagram, sizeof(datagram) - 1, 0, (struct sockaddr*)&client, &clientLength);
+
+		if (length <= 0)
+			continue;
+
+		datagram[length] = '\0';
+
+		if (loss > 0 && rand() % 100 < loss)
+			continue;			// lost on the way
+
+		if (getField(datagram, "i", id, sizeof(id)) == false ||
+			getField(datagram, "s", seqText, sizeof(seqText)) == false ||
+			getField(datagram, "p", payload, sizeof(payload)) == false)
+		{
+			fprintf(stderr, "udpserver: malformed datagram \"%s\"\n", datagram);
+			continue;
+		}
+
+		// devices without sessions stay in session 0
+		if (getField(datagram, "k", sessionText, sizeof(sessionText)) == false)
+			strcpy(sessionText, "0");
+
+		uint16_t seq = (uint16_t)atoi(seqText);
+		Device* device = findDevice(id, (uint16_t)atoi(sessionText));
+
+		if (device == NULL)
+			continue;
+
+		if (receive(device, seq))
+			printFixes(id, seq, payload);
+
+		snprintf(ack, sizeof(ack), "a=%u&b=%08lx", device->seq, (unsigned long)device->bitmap);
+		sendto(sock, ack, strlen(ack), 0, (struct sockaddr*)&client, clientLength);
+	}
+}